@@ -0,0 +1,522 @@
+/**
+ * ANALOG KEY SCANNER (Linear Hall Sensors)
+ *
+ * Liest Note-Switches mit linearen Hall-Sensoren über den ADC:
+ * - ADC scannt alle analogen Keys reihum, gesteuert aus dem Conversion-Complete ISR
+ *   (Kanal umschalten + nächste Wandlung starten, loop() wird nie blockiert)
+ * - Velocity aus der Laufzeit zwischen zwei Schwellen (Travel-Start -> Actuation)
+ * - Mapping der Laufzeit auf Velocity über eine wählbare Kurve (PROGMEM)
+ * - Ersetzt für diese Keys den digitalen Pfad des Key Scanners
+ * - Per-Key Kalibrierung (Ruhe-/Endlage aus einem Sweep, EEPROM via SettingsManager.h)
+ *   und einstellbarer Auslösepunkt (analogActuationDepth)
+ * - Rapid Trigger (optional): Note Off sobald die Taste um ein kleines Delta
+ *   zurückgeht, Note On sobald sie wieder um das Delta nach unten geht -
+ *   unabhängig von den festen Actuation/Release-Schwellen
+ * - Tastendruck hinter dem Auslösepunkt (0-127) für Polyphonic Aftertouch
+ *
+ * INPUT: ADC Kanäle der analog verdrahteten Keys (ANALOG_KEY_MASK in HardwareController.h)
+ * OUTPUT:
+ *   - analogKeyEventFifo[] - Press/Release Events mit Laufzeit und Zeitstempel
+ *     (Single-Producer ADC ISR / Single-Consumer loop())
+ */
+
+#ifndef ANALOG_KEY_SCANNER_H
+#define ANALOG_KEY_SCANNER_H
+
+#include "arduino_stubs.h"
+#include <avr/pgmspace.h>
+
+// ============================================
+// ADC KANAL-MAPPING (Leonardo Pin -> ADC MUX)
+// ============================================
+
+#define NUM_ANALOG_CAPABLE_SLOTS  13   // Ein Eintrag pro Note-Switch
+#define MAX_ANALOG_KEYS           7    // So viele Note-Pins haben einen ADC-Kanal
+#define ADC_MUX_NONE              0xFF
+
+// Kodierung: Bit 5 = MUX5 (ADCSRB), Bits 0-4 = MUX4:0 (ADMUX)
+#define ADC_MUX(ch) (uint8_t)((ch) < 8 ? (ch) : (0x20 | ((ch) - 8)))
+
+// Muss synchron zu switchPins[] (HardwareController.h) bleiben!
+const uint8_t analogKeyMux[NUM_ANALOG_CAPABLE_SLOTS] PROGMEM = {
+  ADC_MUX_NONE,  // D2
+  ADC_MUX_NONE,  // D3
+  ADC_MUX(8),    // D4  (A6)
+  ADC_MUX_NONE,  // D5
+  ADC_MUX(10),   // D6  (A7)
+  ADC_MUX_NONE,  // D7
+  ADC_MUX(11),   // D8  (A8)
+  ADC_MUX(12),   // D9  (A9)
+  ADC_MUX(13),   // D10 (A10)
+  ADC_MUX_NONE,  // D11
+  ADC_MUX(9),    // D12 (A11)
+  ADC_MUX_NONE,  // D13
+  ADC_MUX(7)     // D18 (A0)
+};
+
+// ============================================
+// SCHWELLEN & VELOCITY CONFIG
+// ============================================
+
+// Default-Schwellen ohne Kalibrierung: Rohwerte (10 Bit), steigend mit dem Tastenweg
+#define ANALOG_TRAVEL_THRESHOLD    300   // Taste beginnt sich zu bewegen -> Zeitmessung startet
+#define ANALOG_ACTUATE_THRESHOLD   600   // Note On
+#define ANALOG_RELEASE_THRESHOLD   450   // Note Off (Hysterese zur Actuation)
+#define ANALOG_BOTTOM_THRESHOLD    900   // Endlage (Aftertouch 127)
+#define ANALOG_TRAVEL_HYSTERESIS   20    // Zurück in IDLE, wenn die Taste vor der Actuation umkehrt
+
+// Kalibrierte Schwellen in % des gemessenen Tastenwegs (Ruhelage = 0%, Endlage = 100%)
+#define ANALOG_TRAVEL_START_PERCENT      10
+#define ANALOG_RELEASE_HYST_PERCENT      8
+#define ANALOG_TRAVEL_HYST_PERCENT       2
+#define ANALOG_ACTUATION_DEPTH_DEFAULT   50    // Auslösepunkt in % (klein = schnell, groß = sicher)
+#define ANALOG_ACTUATION_DEPTH_MIN       20
+#define ANALOG_ACTUATION_DEPTH_MAX       90
+#define ANALOG_CALIBRATION_MIN_RANGE     64    // Kleinerer Hub -> Key gilt als nicht kalibriert
+#define KEY_CALIBRATION_DURATION_MS      10000
+#define ANALOG_CAL_REST_SAMPLES          16    // Ruhelage = Mittel der ersten Samples pro Key (~6 ms)
+
+// Rapid Trigger: Richtungswechsel um mehr als das Delta löst Release/Re-Press aus
+#define ANALOG_RAPID_TRIGGER_DELTA       40    // Rohwert-Delta ohne Kalibrierung
+#define ANALOG_RAPID_TRIGGER_PERCENT     8     // Delta in % des kalibrierten Tastenwegs
+#define ANALOG_RAPID_TRIGGER_MIN_DELTA   8     // Untergrenze gegen ADC-Rauschen
+
+// Laufzeit Travel-Start -> Actuation
+#define VELOCITY_FAST_MICROS       3000UL   // <= 3 ms  -> Velocity 127
+#define VELOCITY_SLOW_MICROS       50000UL  // >= 50 ms -> Velocity 1
+
+#define VELOCITY_CURVE_LINEAR 0
+#define VELOCITY_CURVE_SOFT   1
+#define VELOCITY_CURVE_HARD   2
+#define NUM_VELOCITY_CURVES   3
+
+// Stützstellen bei Geschwindigkeit 0, 32, 64 ... 256 (linear interpoliert)
+const uint8_t velocityCurves[NUM_VELOCITY_CURVES][9] PROGMEM = {
+  {1, 16, 32, 48, 64, 80, 96, 112, 127},   // Linear
+  {1, 40, 62, 78, 91, 102, 111, 120, 127}, // Soft: leichter Anschlag klingt lauter
+  {1, 5, 12, 22, 35, 50, 70, 96, 127}      // Hard: volle Velocity nur bei hartem Anschlag
+};
+
+#define ANALOG_KEY_EVENT_FIFO_SIZE 8       // Muss eine Zweierpotenz sein
+
+// ============================================
+// ANALOG KEY SCANNER STATE
+// ============================================
+
+#define ANALOG_KEY_IDLE    0
+#define ANALOG_KEY_TRAVEL  1
+#define ANALOG_KEY_DOWN    2
+#define ANALOG_KEY_LIFTED  3   // Rapid Trigger: Note Off, Taste aber noch nicht ganz oben
+
+struct AnalogKeyEvent {
+  uint8_t key;                  // Switch-Index (0-12)
+  bool pressed;
+  uint16_t travelMicros;        // Laufzeit bis zur Actuation (nur bei Press)
+  unsigned long micros;         // Zeitpunkt der Actuation / des Release
+};
+
+uint8_t numAnalogKeys = 0;
+uint8_t analogKeySwitch[MAX_ANALOG_KEYS];      // Slot -> Switch-Index
+uint8_t analogKeySlotMux[MAX_ANALOG_KEYS];     // Slot -> ADC MUX
+volatile uint8_t analogKeyState[MAX_ANALOG_KEYS];   // Vom ADC-ISR geschrieben, loop() liest mit
+unsigned long analogKeyTravelStart[MAX_ANALOG_KEYS];
+volatile uint16_t analogKeyValue[MAX_ANALOG_KEYS]; // Letzter Rohwert (Diagnose)
+volatile uint8_t analogScanSlot = 0;
+
+uint8_t velocityCurveType = VELOCITY_CURVE_LINEAR;
+
+// Per-Slot Schwellen (im ISR nur verglichen, Berechnung in loop())
+uint16_t analogKeyTravelThr[MAX_ANALOG_KEYS];
+uint16_t analogKeyTravelResetThr[MAX_ANALOG_KEYS];
+uint16_t analogKeyActuateThr[MAX_ANALOG_KEYS];
+uint16_t analogKeyReleaseThr[MAX_ANALOG_KEYS];
+uint16_t analogKeyBottomThr[MAX_ANALOG_KEYS];
+uint8_t analogKeyInvertMask = 0;   // Slot-Bit gesetzt = Wert fällt beim Drücken
+
+// Rapid Trigger: Delta pro Slot, Peak (DOWN) bzw. Trough (LIFTED) der aktuellen Bewegung
+volatile bool analogRapidTrigger = false;
+uint16_t analogKeyRapidDelta[MAX_ANALOG_KEYS];
+uint8_t analogKeyRapidScale[MAX_ANALOG_KEYS];  // Laufzeit-Skalierung Delta -> voller Travel (x16)
+uint16_t analogKeyExtreme[MAX_ANALOG_KEYS];
+
+// Kalibrierung pro Switch-Index (8 Bit = Rohwert >> 2, 0 = nicht kalibriert)
+uint8_t keyCalRest[NUM_ANALOG_CAPABLE_SLOTS];
+uint8_t keyCalBottom[NUM_ANALOG_CAPABLE_SLOTS];
+uint8_t analogActuationDepth = ANALOG_ACTUATION_DEPTH_DEFAULT;
+
+// Sweep-Zustand während der Kalibrierung
+volatile bool analogKeyCalibrating = false;
+uint16_t analogCalRest[MAX_ANALOG_KEYS];          // Summe der Ruhelage-Samples
+uint8_t analogCalRestSamples[MAX_ANALOG_KEYS];
+uint16_t analogCalMin[MAX_ANALOG_KEYS];
+uint16_t analogCalMax[MAX_ANALOG_KEYS];
+unsigned long keyCalibrationStartTime = 0;
+
+AnalogKeyEvent analogKeyEventFifo[ANALOG_KEY_EVENT_FIFO_SIZE];
+volatile uint8_t analogKeyEventHead = 0;
+volatile uint8_t analogKeyEventTail = 0;
+volatile uint8_t analogKeyEventOverflows = 0;
+
+// ============================================
+// ANALOG KEY SCANNER FUNCTIONS
+// ============================================
+
+/**
+ * Wählt den ADC-Kanal (MUX5 liegt beim 32U4 in ADCSRB)
+ */
+inline void selectAnalogKeyChannel(uint8_t mux) {
+  ADMUX = (1 << REFS0) | (mux & 0x1F);   // AVcc Referenz
+  if (mux & 0x20) ADCSRB |= (1 << MUX5);
+  else ADCSRB &= ~(1 << MUX5);
+}
+
+/**
+ * Legt ein Event in die FIFO (nur aus dem ADC ISR aufrufen)
+ */
+inline void pushAnalogKeyEvent(uint8_t key, bool pressed, uint16_t travelMicros, unsigned long timestamp) {
+  uint8_t next = (analogKeyEventHead + 1) & (ANALOG_KEY_EVENT_FIFO_SIZE - 1);
+  if (next == analogKeyEventTail) {
+    analogKeyEventOverflows++;
+    return;
+  }
+  analogKeyEventFifo[analogKeyEventHead].key = key;
+  analogKeyEventFifo[analogKeyEventHead].pressed = pressed;
+  analogKeyEventFifo[analogKeyEventHead].travelMicros = travelMicros;
+  analogKeyEventFifo[analogKeyEventHead].micros = timestamp;
+  analogKeyEventHead = next;
+}
+
+inline bool peekAnalogKeyEvent(AnalogKeyEvent &event) {
+  uint8_t tail = analogKeyEventTail;
+  if (tail == analogKeyEventHead) return false;
+  event = analogKeyEventFifo[tail];
+  return true;
+}
+
+inline void dropAnalogKeyEvent() {
+  analogKeyEventTail = (analogKeyEventTail + 1) & (ANALOG_KEY_EVENT_FIFO_SIZE - 1);
+}
+
+/**
+ * Zustandsmaschine eines analogen Keys für ein neues Sample (aus dem ADC ISR)
+ * IDLE -> TRAVEL (Travel-Schwelle) -> DOWN (Actuation, Note On) -> IDLE (Release)
+ * Rapid Trigger: DOWN -> LIFTED (Peak - Delta, Note Off) -> DOWN (Trough + Delta, Note On)
+ * Invertierte Sensoren werden gespiegelt, danach nur Vergleiche gegen die Slot-Schwellen.
+ */
+inline void processAnalogKeySample(uint8_t slot, uint16_t value) {
+  analogKeyValue[slot] = value;
+
+  if (analogKeyCalibrating) {
+    // Ruhelage aus den ersten Samples des Sweeps mitteln: beim Start hat der ADC
+    // noch nicht jeden Kanal gewandelt, analogKeyValue[] wäre dort noch 0
+    if (analogCalRestSamples[slot] < ANALOG_CAL_REST_SAMPLES) {
+      analogCalRest[slot] += value;
+      analogCalRestSamples[slot]++;
+    }
+    if (value < analogCalMin[slot]) analogCalMin[slot] = value;
+    if (value > analogCalMax[slot]) analogCalMax[slot] = value;
+    return;
+  }
+
+  if (analogKeyInvertMask & (1 << slot)) value = 1023 - value;
+
+  switch (analogKeyState[slot]) {
+    case ANALOG_KEY_IDLE:
+      if (value >= analogKeyTravelThr[slot]) {
+        analogKeyTravelStart[slot] = micros();
+        analogKeyState[slot] = ANALOG_KEY_TRAVEL;
+      }
+      break;
+
+    case ANALOG_KEY_TRAVEL:
+      if (value >= analogKeyActuateThr[slot]) {
+        unsigned long now = micros();
+        unsigned long travel = now - analogKeyTravelStart[slot];
+        if (travel > 0xFFFF) travel = 0xFFFF;
+        pushAnalogKeyEvent(analogKeySwitch[slot], true, (uint16_t)travel, now);
+        analogKeyExtreme[slot] = value;
+        analogKeyState[slot] = ANALOG_KEY_DOWN;
+      } else if (value < analogKeyTravelResetThr[slot]) {
+        analogKeyState[slot] = ANALOG_KEY_IDLE;
+      }
+      break;
+
+    case ANALOG_KEY_DOWN:
+      if (value < analogKeyReleaseThr[slot]) {
+        pushAnalogKeyEvent(analogKeySwitch[slot], false, 0, micros());
+        analogKeyState[slot] = ANALOG_KEY_IDLE;
+      } else if (analogRapidTrigger) {
+        if (value > analogKeyExtreme[slot]) {
+          analogKeyExtreme[slot] = value;
+        } else if (analogKeyExtreme[slot] - value >= analogKeyRapidDelta[slot]) {
+          unsigned long now = micros();
+          pushAnalogKeyEvent(analogKeySwitch[slot], false, 0, now);
+          analogKeyExtreme[slot] = value;
+          analogKeyTravelStart[slot] = now;
+          analogKeyState[slot] = ANALOG_KEY_LIFTED;
+        }
+      }
+      break;
+
+    case ANALOG_KEY_LIFTED:
+      if (value < analogKeyTravelResetThr[slot]) {
+        // Ganz losgelassen: zurück in den normalen Pfad
+        analogKeyState[slot] = ANALOG_KEY_IDLE;
+      } else if (value < analogKeyExtreme[slot]) {
+        analogKeyExtreme[slot] = value;
+        analogKeyTravelStart[slot] = micros();
+      } else if (value - analogKeyExtreme[slot] >= analogKeyRapidDelta[slot]) {
+        // Re-Press: Laufzeit über das Delta auf den vollen Travel hochrechnen (Velocity)
+        unsigned long now = micros();
+        unsigned long travel = ((now - analogKeyTravelStart[slot]) * analogKeyRapidScale[slot]) >> 4;
+        if (travel > 0xFFFF) travel = 0xFFFF;
+        pushAnalogKeyEvent(analogKeySwitch[slot], true, (uint16_t)travel, now);
+        analogKeyExtreme[slot] = value;
+        analogKeyState[slot] = ANALOG_KEY_DOWN;
+      }
+      break;
+  }
+}
+
+/**
+ * ADC Conversion Complete: Sample auswerten, nächsten Kanal wählen, neu starten
+ */
+ISR(ADC_vect) {
+  uint16_t value = ADC;
+  uint8_t slot = analogScanSlot;
+  processAnalogKeySample(slot, value);
+
+  if (++slot >= numAnalogKeys) slot = 0;
+  analogScanSlot = slot;
+  selectAnalogKeyChannel(analogKeySlotMux[slot]);
+  ADCSRA |= (1 << ADSC);
+}
+
+/**
+ * Laufzeit (µs) -> MIDI Velocity (1-127) über die gewählte Kurve
+ */
+uint8_t travelToVelocity(uint16_t travelMicros) {
+  unsigned long travel = travelMicros;
+  if (travel < VELOCITY_FAST_MICROS) travel = VELOCITY_FAST_MICROS;
+  if (travel > VELOCITY_SLOW_MICROS) travel = VELOCITY_SLOW_MICROS;
+
+  // Geschwindigkeit 0 (langsam) .. 256 (schnell)
+  uint16_t speed = (uint16_t)(((VELOCITY_SLOW_MICROS - travel) * 256UL) / (VELOCITY_SLOW_MICROS - VELOCITY_FAST_MICROS));
+
+  uint8_t curve = (velocityCurveType < NUM_VELOCITY_CURVES) ? velocityCurveType : VELOCITY_CURVE_LINEAR;
+  uint8_t idx = speed >> 5;
+  if (idx >= 8) return pgm_read_byte(&velocityCurves[curve][8]);
+  uint8_t v0 = pgm_read_byte(&velocityCurves[curve][idx]);
+  uint8_t v1 = pgm_read_byte(&velocityCurves[curve][idx + 1]);
+  return v0 + (uint8_t)(((uint16_t)(v1 - v0) * (speed & 0x1F)) >> 5);
+}
+
+/**
+ * Tastendruck hinter dem Auslösepunkt für einen Switch-Index:
+ * 0 = Auslösepunkt (oder Key nicht gedrückt / nicht analog), 127 = Endlage
+ */
+uint8_t getAnalogKeyPressure(uint8_t key) {
+  for (uint8_t slot = 0; slot < numAnalogKeys; slot++) {
+    if (analogKeySwitch[slot] != key) continue;
+    // 16-Bit Wert aus dem ADC-ISR (alle ~52 µs neu) nur atomar lesen, sonst reißen High/Low-Byte
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t state = analogKeyState[slot];
+    uint16_t value = analogKeyValue[slot];
+    SREG = sreg;
+    if (state != ANALOG_KEY_DOWN) return 0;
+
+    if (analogKeyInvertMask & (1 << slot)) value = 1023 - value;
+    uint16_t actuate = analogKeyActuateThr[slot];
+    uint16_t bottom = analogKeyBottomThr[slot];
+    if (value <= actuate || bottom <= actuate) return 0;
+    if (value >= bottom) return 127;
+    return (uint8_t)(((uint32_t)(value - actuate) * 127) / (bottom - actuate));
+  }
+  return 0;
+}
+
+/**
+ * Berechnet die Slot-Schwellen aus Kalibrierung und Auslösepunkt (nur Integer-Mathe).
+ * Nicht kalibrierte Keys nutzen die Default-Schwellen.
+ */
+void computeAnalogKeyThresholds() {
+  uint8_t depth = analogActuationDepth;
+  if (depth < ANALOG_ACTUATION_DEPTH_MIN) depth = ANALOG_ACTUATION_DEPTH_MIN;
+  if (depth > ANALOG_ACTUATION_DEPTH_MAX) depth = ANALOG_ACTUATION_DEPTH_MAX;
+
+  for (uint8_t slot = 0; slot < numAnalogKeys; slot++) {
+    uint8_t key = analogKeySwitch[slot];
+    int16_t rest = (int16_t)keyCalRest[key] << 2;
+    int16_t bottom = (int16_t)keyCalBottom[key] << 2;
+    bool inverted = bottom < rest;
+    if (inverted) {
+      // In den gespiegelten Wertebereich des ISR umrechnen
+      rest = 1023 - rest;
+      bottom = 1023 - bottom;
+    }
+    int16_t range = bottom - rest;
+
+    uint16_t travelThr, travelResetThr, actuateThr, releaseThr, bottomThr, rapidDelta;
+    if (keyCalBottom[key] == 0 || range < ANALOG_CALIBRATION_MIN_RANGE) {
+      inverted = false;
+      travelThr = ANALOG_TRAVEL_THRESHOLD;
+      travelResetThr = ANALOG_TRAVEL_THRESHOLD - ANALOG_TRAVEL_HYSTERESIS;
+      actuateThr = ANALOG_ACTUATE_THRESHOLD;
+      releaseThr = ANALOG_RELEASE_THRESHOLD;
+      bottomThr = ANALOG_BOTTOM_THRESHOLD;
+      rapidDelta = ANALOG_RAPID_TRIGGER_DELTA;
+    } else {
+      travelThr = rest + (int32_t)range * ANALOG_TRAVEL_START_PERCENT / 100;
+      travelResetThr = travelThr - (int32_t)range * ANALOG_TRAVEL_HYST_PERCENT / 100;
+      actuateThr = rest + (int32_t)range * depth / 100;
+      releaseThr = actuateThr - (int32_t)range * ANALOG_RELEASE_HYST_PERCENT / 100;
+      if (releaseThr <= travelThr) releaseThr = travelThr + 1;
+      bottomThr = bottom;
+      rapidDelta = (int32_t)range * ANALOG_RAPID_TRIGGER_PERCENT / 100;
+      if (rapidDelta < ANALOG_RAPID_TRIGGER_MIN_DELTA) rapidDelta = ANALOG_RAPID_TRIGGER_MIN_DELTA;
+    }
+    uint16_t rapidScale = (uint16_t)(((actuateThr - travelThr) << 4) / rapidDelta);
+    if (rapidScale > 255) rapidScale = 255;
+
+    cli();
+    analogKeyTravelThr[slot] = travelThr;
+    analogKeyTravelResetThr[slot] = travelResetThr;
+    analogKeyActuateThr[slot] = actuateThr;
+    analogKeyReleaseThr[slot] = releaseThr;
+    analogKeyBottomThr[slot] = bottomThr;
+    analogKeyRapidDelta[slot] = rapidDelta;
+    analogKeyRapidScale[slot] = (uint8_t)rapidScale;
+    if (inverted) analogKeyInvertMask |= (1 << slot);
+    else analogKeyInvertMask &= ~(1 << slot);
+    sei();
+  }
+}
+
+/**
+ * Setzt den Auslösepunkt (in % des Tastenwegs) und rechnet die Schwellen neu
+ */
+void setAnalogActuationDepth(uint8_t depth) {
+  analogActuationDepth = depth;
+  computeAnalogKeyThresholds();
+}
+
+/**
+ * Rapid Trigger ein/aus. Beim Ausschalten werden angehobene Keys wie losgelassen
+ * behandelt (die Note Off wurde bereits gesendet).
+ */
+void setAnalogRapidTrigger(bool enabled) {
+  cli();
+  analogRapidTrigger = enabled;
+  if (!enabled) {
+    for (uint8_t slot = 0; slot < numAnalogKeys; slot++) {
+      if (analogKeyState[slot] == ANALOG_KEY_LIFTED) analogKeyState[slot] = ANALOG_KEY_IDLE;
+    }
+  }
+  sei();
+}
+
+/**
+ * Startet den Kalibrier-Sweep. Alle Keys müssen dabei in Ruhelage starten und
+ * während KEY_CALIBRATION_DURATION_MS einmal ganz durchgedrückt werden.
+ * Während der Kalibrierung werden keine Noten erzeugt.
+ */
+void startKeyCalibration() {
+  if (numAnalogKeys == 0) return;
+  cli();
+  for (uint8_t slot = 0; slot < numAnalogKeys; slot++) {
+    analogCalRest[slot] = 0;
+    analogCalRestSamples[slot] = 0;
+    analogCalMin[slot] = 1023;
+    analogCalMax[slot] = 0;
+    analogKeyState[slot] = ANALOG_KEY_IDLE;
+  }
+  analogKeyCalibrating = true;
+  sei();
+  keyCalibrationStartTime = millis();
+}
+
+/**
+ * Beendet den Sweep: Endlage = das Extrem, das weiter von der Ruhelage entfernt ist.
+ * Keys ohne gültige Ruhelage oder mit zu kleinem Hub behalten ihre bisherige Kalibrierung.
+ */
+void finishKeyCalibration() {
+  analogKeyCalibrating = false;
+  for (uint8_t slot = 0; slot < numAnalogKeys; slot++) {
+    cli();
+    uint16_t restSum = analogCalRest[slot];
+    uint8_t restSamples = analogCalRestSamples[slot];
+    uint16_t lo = analogCalMin[slot];
+    uint16_t hi = analogCalMax[slot];
+    sei();
+    if (restSamples < ANALOG_CAL_REST_SAMPLES) continue; // Zu wenige Samples
+    uint16_t rest = restSum / ANALOG_CAL_REST_SAMPLES;
+
+    int16_t up = (int16_t)hi - (int16_t)rest;
+    int16_t down = (int16_t)rest - (int16_t)lo;
+    uint16_t bottom = (up >= down) ? hi : lo;
+    int16_t span = (up >= down) ? up : down;
+    // Sensor fehlt/liegt auf GND oder Key wurde nicht durchgedrückt
+    if ((rest >> 2) == 0 || span < ANALOG_CALIBRATION_MIN_RANGE) continue;
+
+    uint8_t key = analogKeySwitch[slot];
+    keyCalRest[key] = rest >> 2;
+    keyCalBottom[key] = bottom >> 2;
+    if (keyCalBottom[key] == 0) keyCalBottom[key] = 1; // 0 ist "nicht kalibriert"
+  }
+  computeAnalogKeyThresholds();
+}
+
+/**
+ * Läuft die Kalibrierung? Beendet sie automatisch nach KEY_CALIBRATION_DURATION_MS.
+ * Rückgabe: true genau in dem Frame, in dem die Kalibrierung abgeschlossen wurde.
+ */
+bool updateKeyCalibration() {
+  if (!analogKeyCalibrating) return false;
+  if (millis() - keyCalibrationStartTime < KEY_CALIBRATION_DURATION_MS) return false;
+  finishKeyCalibration();
+  return true;
+}
+
+/**
+ * Initialisiert den ADC-Scan für die in analogMask gesetzten Switches.
+ * Switches ohne ADC-Kanal werden ignoriert.
+ * Rückgabe: Maske der tatsächlich analog gescannten Switches
+ */
+uint16_t initAnalogKeyScanner(uint16_t analogMask) {
+  numAnalogKeys = 0;
+  for (uint8_t i = 0; i < NUM_ANALOG_CAPABLE_SLOTS && numAnalogKeys < MAX_ANALOG_KEYS; i++) {
+    uint8_t mux = pgm_read_byte(&analogKeyMux[i]);
+    if ((analogMask & (1 << i)) && mux != ADC_MUX_NONE) {
+      analogKeySwitch[numAnalogKeys] = i;
+      analogKeySlotMux[numAnalogKeys] = mux;
+      analogKeyState[numAnalogKeys] = ANALOG_KEY_IDLE;
+      analogKeyTravelStart[numAnalogKeys] = 0;
+      analogKeyValue[numAnalogKeys] = 0;
+      numAnalogKeys++;
+      // Digitalen Eingangspuffer abschalten: der Hall-Sensor liegt meist bei
+      // halber Versorgung, der Schmitt-Trigger würde dort Strom ziehen und den ADC stören
+      if (mux & 0x20) DIDR2 |= (1 << (mux & 0x07));   // ADC8-13 -> ADC8D..ADC13D
+      else DIDR0 |= (1 << mux);                       // ADC0-7  -> ADC0D..ADC7D
+    }
+  }
+  analogKeyEventHead = 0;
+  analogKeyEventTail = 0;
+  analogKeyEventOverflows = 0;
+
+  uint16_t activeMask = 0;
+  for (uint8_t s = 0; s < numAnalogKeys; s++) activeMask |= (1 << analogKeySwitch[s]);
+  if (numAnalogKeys == 0) return 0;
+
+  // Default-Schwellen bis die Kalibrierung aus dem EEPROM geladen ist
+  computeAnalogKeyThresholds();
+
+  // ADC: AVcc Referenz, Prescaler 64 (250 kHz, ~52 µs pro Wandlung), Interrupt an
+  analogScanSlot = 0;
+  selectAnalogKeyChannel(analogKeySlotMux[0]);
+  ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1);
+  ADCSRA |= (1 << ADSC);
+  return activeMask;
+}
+
+#endif
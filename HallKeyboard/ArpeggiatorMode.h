@@ -8,18 +8,21 @@
  * - 50% Duty Cycle für Note ON/OFF
  * 
  * INPUT:
- *   - switch_triggered[], switch_released[] vom Hardware Controller
+ *   - keyPressedMask, keyReleasedMask vom Hardware Controller
  *   - arpeggiatorActive, arpeggiatorMode, arpeggiatorRate aus Software Controller
  *   - tapTempo.getBeatLength()
+ *   - noteEventMicros - Zeitstempel des Tastendrucks (Input-Quantisierung)
  * 
  * OUTPUT:
  *   - arpeggiatorMidiNotes[] - Welche Note soll gerade vom Arp spielen
+ *   - Note Events (Layer ARP) auf dem MIDI Event Bus
  */
 
 #ifndef ARPEGGIATOR_MODE_H
 #define ARPEGGIATOR_MODE_H
 
 #include "ArduinoTapTempo.h"
+#include "MidiEventBus.h"
 
 // ============================================
 // ARPEGGIATOR MODE STATE & CONFIG
@@ -42,12 +45,34 @@ bool arpeggiatorNoteIsOn = false;
 float lastArpeggiatorSyncProgress = 0;
 int arpeggiatorBeatCounter = 0;
 float lastArpeggiatorRawProgress = 0;
-int lastArpeggiatorSyncPulse = -1; // Neu: Für präzisen MIDI Clock Sync
 bool arpWaitingForSync = false;    // Ob der ARP auf den nächsten Downbeat wartet
 
+// Clock-Sync über die Phase (Sub-Ticks, siehe getClockPhase())
+#define ARP_STEP_NONE 0xFFFFFFFFUL
+uint32_t lastArpeggiatorStepStart = ARP_STEP_NONE;   // ARP_STEP_NONE = nach Phasen-Reset
+uint32_t lastArpeggiatorPhase = 0;
+uint8_t lastArpeggiatorRatchet = 0;
+uint32_t arpeggiatorNoteOnPhase = 0;
+
+// Swing: Anteil des ersten Steps an einem Step-Paar in % (50 = gerade)
+#ifndef ARP_SWING_DEFAULT
+#define ARP_SWING_DEFAULT 50
+#endif
+uint8_t arpeggiatorSwing = ARP_SWING_DEFAULT;
+
+// Ratchets: Wiederholungen derselben Note pro Step (1 = aus)
+#ifndef ARP_RATCHETS_DEFAULT
+#define ARP_RATCHETS_DEFAULT 1
+#endif
+uint8_t arpeggiatorRatchets = ARP_RATCHETS_DEFAULT;
+
+// Input-Quantisierung: Erste Note knapp nach einem (leeren) Step zählt noch zu diesem Step
+#define ARP_LATE_PRESS_PERCENT 25          // Fenster in % der Step-Dauer
+unsigned long lastArpeggiatorTriggerMicros = 0;
+bool arpeggiatorCatchUp = false;
+
 int8_t heldArpeggiatorNotes[32];
 int8_t numHeldArpeggiatorNotes = 0;
-uint8_t arpNoteRefCount[128];
 int8_t currentArpeggiatorIndex = 0;
 bool arpeggiatorAscending = true;
 
@@ -58,11 +83,14 @@ ArduinoTapTempo tapTempo;
 // EXTERNE VARIABLEN & FUNKTIONEN
 // ============================================
 extern bool arpeggiatorActive;
-extern void sendMidiNote(int cmd, int pitch, int velocity);
+extern unsigned long noteEventMicros;
 
 // MIDI Clock Sync
 extern volatile uint16_t masterPulseCounter;
 extern volatile bool midiClockRunning;
+extern unsigned long getMidiClockPeriodMicros();
+extern uint32_t getClockPhase();
+extern bool midiClockStopped;
 
 // Konstanten
 #ifndef ARPEGGIATOR_UP_DOWN
@@ -78,6 +106,17 @@ extern volatile bool midiClockRunning;
 // ============================================
 void playNextArpeggiatorNote();
 
+/**
+ * Laufende Arp-Note beenden (gibt nur die eigene Stimme frei, eine gleichzeitig
+ * per Hold oder Taste gehaltene Tonhöhe klingt weiter)
+ */
+void stopArpeggiatorNote() {
+  if (arpeggiatorNoteIsOn && currentArpeggiatorPlayingNote >= 0) {
+    postMidiEvent(midiNoteOffEvent(MIDI_LAYER_ARP, currentArpeggiatorPlayingNote));
+  }
+  arpeggiatorNoteIsOn = false;
+}
+
 // ============================================
 // ARPEGGIATOR MODE FUNCTIONS
 // ============================================
@@ -87,9 +126,6 @@ void initArpeggiatorMode() {
   for (int i = 0; i < 13; i++) { // Should be 32? Wait, the loop in original was for 13
     heldArpeggiatorNotes[i] = -1;
   }
-  for (int i = 0; i < 128; i++) {
-    arpNoteRefCount[i] = 0;
-  }
   numHeldArpeggiatorNotes = 0;
   currentArpeggiatorIndex = 0;
   arpeggiatorAscending = true;
@@ -103,14 +139,107 @@ void resetArpeggiatorPhase() {
   lastArpeggiatorSyncProgress = -1.0; // Force immediate trigger on next update
   arpeggiatorBeatCounter = 0;
   lastArpeggiatorRawProgress = 0;
-  lastArpeggiatorSyncPulse = -1;  // Reset MIDI Pulse Sync
+  lastArpeggiatorStepStart = ARP_STEP_NONE;  // Reset Clock-Phasen Sync
+  lastArpeggiatorPhase = 0;
+  lastArpeggiatorRatchet = 0;
   currentArpeggiatorIndex = -1; // So the first note played will be index 0
   arpeggiatorAscending = true;
 }
 
+/**
+ * Step-Länge in Sub-Ticks (CLOCK_PHASE_PPQN pro Beat) aus der Rate
+ */
+uint16_t getArpeggiatorStepTicks() {
+  // Im Sequence Mode ist die Rate fest auf Whole Note (4 Beats)
+  if (arpeggiatorMode == ARPEGGIATOR_SEQUENCE) return CLOCK_PHASE_BAR;
+  switch (arpeggiatorRate) {
+    case RATE_WHOLE:        return CLOCK_PHASE_BAR;
+    case RATE_QUARTER:      return CLOCK_PHASE_PPQN;
+    case RATE_EIGHTH:       return CLOCK_PHASE_PPQN / 2;
+    case RATE_SIXTEENTH:    return CLOCK_PHASE_PPQN / 4;
+    case RATE_TRIPLET:      return CLOCK_PHASE_PPQN / 3;
+    default:                return CLOCK_PHASE_PPQN / 2;
+  }
+}
+
+/**
+ * Beginn und Länge des Steps, in dem die Phase liegt (mit Swing)
+ * Swing verschiebt den zweiten Step jedes Paares nach hinten; nur bei geraden
+ * Raten, deren Paare einen Takt füllen (nicht bei Triolen oder ganzen Noten)
+ */
+void getArpeggiatorStep(uint32_t phase, uint16_t stepTicks, uint32_t &stepStart, uint16_t &stepLength) {
+  uint16_t pairTicks = stepTicks * 2;
+  bool triplet = (stepTicks == CLOCK_PHASE_PPQN / 3);   // Paare würden 2/3 Beat überspannen
+  if (arpeggiatorSwing == 50 || triplet || stepTicks >= CLOCK_PHASE_BAR || CLOCK_PHASE_BAR % pairTicks != 0) {
+    stepStart = phase - phase % stepTicks;
+    stepLength = stepTicks;
+    return;
+  }
+  uint32_t pairStart = phase - phase % pairTicks;
+  uint16_t firstTicks = (uint32_t)pairTicks * arpeggiatorSwing / 100;
+  if (phase - pairStart < firstTicks) {
+    stepStart = pairStart;
+    stepLength = firstTicks;
+  } else {
+    stepStart = pairStart + firstTicks;
+    stepLength = pairTicks - firstTicks;
+  }
+}
+
+/**
+ * Song Position Pointer: Phase zurücksetzen und den Index so stellen, als wäre
+ * der Arp seit Songanfang gelaufen (gerades Raster, Swing verschiebt keine Step-Nummern).
+ * pulses = Position in 24-PPQN Pulsen, dort startet der nächste externe Puls.
+ */
+void syncArpeggiatorToSongPosition(uint32_t pulses) {
+  resetArpeggiatorPhase();
+  int count = numHeldArpeggiatorNotes;
+  if (count < 2) return;   // Keine oder eine Note: Start bei Index 0 wie nach resetArpeggiatorPhase()
+
+  // Nummer des nächsten Steps ab Songanfang (liegt die Position mitten im Step: der folgende)
+  uint32_t stepTicks = getArpeggiatorStepTicks();
+  uint32_t ticks = pulses * CLOCK_PHASE_PER_PULSE;
+  uint32_t step = (ticks + stepTicks - 1) / stepTicks;
+  if (step == 0) return;
+
+  // Zustand nach dem vorherigen Step, playNextArpeggiatorNote() rechnet von dort weiter
+  uint32_t prev = step - 1;
+  int cycle = 2 * (count - 1);   // Up-Down / Down-Up ohne doppelte Umkehrnoten
+  switch (arpeggiatorMode) {
+    case ARPEGGIATOR_DOWN:
+      currentArpeggiatorIndex = count - 1 - (int)(prev % count);
+      break;
+    case ARPEGGIATOR_UP_DOWN: {
+      int m = prev % cycle;
+      currentArpeggiatorIndex = (m < count) ? m : cycle - m;
+      arpeggiatorAscending = (m < count);
+      break;
+    }
+    case ARPEGGIATOR_DOWN_UP: {
+      int m = prev % cycle;
+      currentArpeggiatorIndex = (m < count) ? count - 1 - m : m - (count - 1);
+      arpeggiatorAscending = (m >= count);
+      break;
+    }
+    default:   // UP, SEQUENCE
+      currentArpeggiatorIndex = prev % count;
+      break;
+  }
+}
+
+/**
+ * Ratchet: laufende Note innerhalb des Steps neu anschlagen
+ */
+void retriggerArpeggiatorNote() {
+  stopArpeggiatorNote();
+  postMidiEvent(midiNoteOnEvent(MIDI_LAYER_ARP, currentArpeggiatorPlayingNote, 0x45));
+  arpeggiatorNoteIsOn = true;
+}
+
 /**
  * Aktualisiere Arpeggiator in jedem Loop-Durchgang
  * - Berechne neue Step-Dauer basierend auf Tap Tempo
+ * - Mit Clock: Steps, Swing, Ratchets und Gate aus der Clock-Phase
  * - Prüfe ob Note OFF werden soll (Duty Cycle)
  * - Prüfe ob nächste Note spielen soll
  */
@@ -120,6 +249,11 @@ void updateArpeggiatorMode() {
     return;
   }
 
+  // Externer Transport per MIDI Stop angehalten: keine Steps bis Start/Continue
+  if (midiClockStopped) {
+    return;
+  }
+
   // Wartet der ARP auf den Downbeat (die "1")?
   if (arpWaitingForSync) {
     if (midiClockRunning || midiClockActive) {
@@ -138,73 +272,63 @@ void updateArpeggiatorMode() {
     }
   }
   
-  // Berechne StepDuration basierend auf Rate und Tap Tempo
-  unsigned long beatLength = tapTempo.getBeatLength();
+  // Step-Länge in Sub-Ticks des Phasen-Akkumulators (3840 PPQN), Dauer in ms
+  // (bei externer Clock die geglättete Periode der Clock-PLL, ms pro Beat)
+  uint16_t stepTicks = getArpeggiatorStepTicks();
+  unsigned long beatLength = midiClockActive ? getMidiClockPeriodMicros() * 24 / 1000 : tapTempo.getBeatLength();
   if (beatLength <= 0) return;
-
-  float divisions = 1.0;
-  if (arpeggiatorMode == ARPEGGIATOR_SEQUENCE) {
-    // Im Sequence Mode ist die Rate fest auf Whole Note (4 Beats)
-    divisions = 0.25;
-  } else {
-    switch(arpeggiatorRate) {
-      case RATE_WHOLE:        divisions = 0.25; break;
-      case RATE_QUARTER:      divisions = 1.0; break;
-      case RATE_EIGHTH:       divisions = 2.0; break;
-      case RATE_SIXTEENTH:    divisions = 4.0; break;
-      case RATE_TRIPLET:      divisions = 3.0; break;
-      default:                divisions = 2.0; break;
-    }
-  }
-  
-  arpeggiatorStepDuration = beatLength / divisions;
+  arpeggiatorStepDuration = beatLength * stepTicks / CLOCK_PHASE_PPQN;
   
   unsigned long currentTime = millis();
-  float currentRawProgress = tapTempo.beatProgress();
-  
-  // Update beat counter based on wrap-around of raw progress
-  // Aber NUR wenn keine Clock läuft - bei Clock nutzen wir masterPulseCounter
-  if (!(midiClockRunning || midiClockActive)) {
+  int dutyCycle = (arpeggiatorMode == ARPEGGIATOR_SEQUENCE) ? 99 : arpeggiatorDutyCycle;
+  bool trigger = false;
+  bool ratchet = false;
+  bool clocked = midiClockRunning || midiClockActive;
+  uint32_t phase = 0;
+
+  // Nutze die Clock-Phase wenn entweder der interne Generator oder eine externe Clock läuft
+  if (clocked) {
+    // Hochauflösende Phase zwischen den Pulsen, nur Integer-Rechnung
+    phase = getClockPhase();
+    arpeggiatorBeatCounter = phase / CLOCK_PHASE_PPQN;
+
+    uint32_t stepStart;
+    uint16_t stepLength;
+    getArpeggiatorStep(phase, stepTicks, stepStart, stepLength);
+    uint16_t ratchetTicks = stepLength / (arpeggiatorRatchets > 0 ? arpeggiatorRatchets : 1);
+    uint8_t ratchetIndex = (phase - stepStart) / ratchetTicks;
+
+    if (lastArpeggiatorStepStart == ARP_STEP_NONE) {
+      // Nach einem Phasen-Reset: nur triggern, wenn wir noch im ersten Puls des Steps sind
+      trigger = (phase - stepStart) < CLOCK_PHASE_PER_PULSE;
+    } else if (stepStart != lastArpeggiatorStepStart || phase < lastArpeggiatorPhase) {
+      trigger = true;   // Neuer Step (oder Takt-Wrap bei ganzen Noten)
+    } else if (ratchetIndex != lastArpeggiatorRatchet) {
+      ratchet = true;   // Wiederholung innerhalb des Steps
+    }
+    lastArpeggiatorStepStart = stepStart;
+    lastArpeggiatorPhase = phase;
+    lastArpeggiatorRatchet = ratchetIndex;
+
+    // Gate in Sub-Ticks (relativ zur Ratchet-Länge), Phase läuft am Taktende über
+    if (arpeggiatorNoteIsOn && !trigger && !ratchet) {
+      uint32_t gateElapsed = (phase + CLOCK_PHASE_BAR - arpeggiatorNoteOnPhase) % CLOCK_PHASE_BAR;
+      if (gateElapsed >= (uint32_t)ratchetTicks * dutyCycle / 100) {
+        stopArpeggiatorNote();
+      }
+    }
+    if (trigger || ratchet) arpeggiatorNoteOnPhase = phase - (phase - stepStart) % ratchetTicks;
+  } else {
+    // Keine Clock: Phase-Lock zum Tap Tempo
+    float divisions = (float)CLOCK_PHASE_PPQN / stepTicks;
+    float currentRawProgress = tapTempo.beatProgress();
     if (currentRawProgress < lastArpeggiatorRawProgress) {
       arpeggiatorBeatCounter = (arpeggiatorBeatCounter + 1) % 4; // Cycle through 4 beats
     }
-  } else {
-    // Bei MIDI Clock: Berechne den Beat direkt aus dem masterPulseCounter (0-95)
-    // masterPulseCounter 0-23 = Beat 0, 24-47 = Beat 1, etc.
-    arpeggiatorBeatCounter = masterPulseCounter / 24;
-  }
-  lastArpeggiatorRawProgress = currentRawProgress;
-
-  // Calculate continuous progress across 4 beats (0.0 to 4.0)
-  float continuousProgress;
-  if (!(midiClockRunning || midiClockActive)) {
-    continuousProgress = (float)arpeggiatorBeatCounter + currentRawProgress;
-  } else {
-    // Hochpräzise kontinuierliche Phase aus Pulsen
-    continuousProgress = (float)masterPulseCounter / 24.0;
-  }
-  
-  // Scaled progress determines the trigger points
-  float scaledProgress = continuousProgress * divisions;
-  
-  // Trigger Logic: Prüfe ob Master-Phase eine Schwelle überschritten hat (Phasen-Lock zum Tap Tempo)
-  bool trigger = false;
-
-  // Nutze Pulse-Sync wenn entweder der interne Generator oder eine externe Clock läuft
-  if (midiClockRunning || midiClockActive) {
-    // Hochpräziser Sync zur MIDI Clock (Intern oder Extern)
-    int pulsesPerStep = (int)(24.0 / divisions);
-    if (pulsesPerStep < 1) pulsesPerStep = 1;
+    lastArpeggiatorRawProgress = currentRawProgress;
 
-    // Trigger wenn ein neuer Pulse die Schwelle überschreitet
-    if (masterPulseCounter != lastArpeggiatorSyncPulse && (masterPulseCounter % pulsesPerStep == 0)) {
-      trigger = true;
-    }
-    lastArpeggiatorSyncPulse = masterPulseCounter;
-    
-    // Wir aktualisieren trotzdem scaledProgress für Legato/Duty-Cycle Logik unten
-  } else {
-    // Normaler Fall: Phase-Lock zum Tap Tempo
+    // Continuous progress across 4 beats (0.0 to 4.0), scaled progress determines the trigger points
+    float scaledProgress = ((float)arpeggiatorBeatCounter + currentRawProgress) * divisions;
     if (floor(scaledProgress) != floor(lastArpeggiatorSyncProgress)) {
       trigger = true;
     } 
@@ -212,28 +336,34 @@ void updateArpeggiatorMode() {
     else if (scaledProgress < lastArpeggiatorSyncProgress) {
       trigger = true;
     }
+    lastArpeggiatorSyncProgress = scaledProgress;
+
+    if (arpeggiatorNoteIsOn && !trigger && currentTime - arpeggiatorNoteOnTime >= (arpeggiatorStepDuration * dutyCycle / 100)) {
+      stopArpeggiatorNote();
+    }
+  }
+
+  if (trigger) {
+    lastArpeggiatorTriggerMicros = micros();
+    arpeggiatorCatchUp = false;
+  }
+
+  // Zu spät gedrückte erste Note: Step nachholen statt einen ganzen Step zu warten
+  if (arpeggiatorCatchUp) {
+    arpeggiatorCatchUp = false;
+    if (numHeldArpeggiatorNotes > 0 && !arpeggiatorNoteIsOn) {
+      trigger = true;
+      arpeggiatorNoteOnPhase = phase;   // Gate ab jetzt, nicht ab Step-Beginn
+    }
   }
 
   // Nur spielen, wenn auch Noten da sind
   if (trigger && numHeldArpeggiatorNotes > 0) {
     playNextArpeggiatorNote();
     arpeggiatorNoteOnTime = currentTime;
-  }
-
-  // Immer den Sync-Status aktualisieren
-  lastArpeggiatorSyncProgress = scaledProgress;
-
-  // Duty Cycle: Prüfe ob Note OFF sein sollte
-  // Im Sequence Mode fest 99% für Legato-Effekt, sonst nutzen wir den globalen Wert
-  if (numHeldArpeggiatorNotes > 0) {
-    int dutyCycle = (arpeggiatorMode == ARPEGGIATOR_SEQUENCE) ? 99 : arpeggiatorDutyCycle;
-    if (arpeggiatorNoteIsOn && currentTime - arpeggiatorNoteOnTime >= (arpeggiatorStepDuration * dutyCycle / 100)) {
-      // Zeit für Note Off!
-      if (currentArpeggiatorPlayingNote >= 0 && currentArpeggiatorPlayingNote < 128) {
-        sendMidiNote(0x80, currentArpeggiatorPlayingNote, 0);
-        arpeggiatorNoteIsOn = false;
-      }
-    }
+  } else if (ratchet && numHeldArpeggiatorNotes > 0 && currentArpeggiatorPlayingNote >= 0) {
+    retriggerArpeggiatorNote();
+    arpeggiatorNoteOnTime = currentTime;
   }
 }
 
@@ -344,12 +474,10 @@ void playNextArpeggiatorNote() {
   
   if (noteToPlay >= 0 && noteToPlay < 128) {
     // Schalte alte Note aus
-    if (currentArpeggiatorPlayingNote >= 0 && currentArpeggiatorPlayingNote < 128) {
-      sendMidiNote(0x80, currentArpeggiatorPlayingNote, 0);
-    }
+    stopArpeggiatorNote();
     
     // Spiele neue Note
-    sendMidiNote(0x90, noteToPlay, 0x45);
+    postMidiEvent(midiNoteOnEvent(MIDI_LAYER_ARP, noteToPlay, 0x45));
     currentArpeggiatorPlayingNote = noteToPlay;
     arpeggiatorNoteIsOn = true;
     arpeggiatorNoteOnTime = millis();
@@ -361,7 +489,7 @@ void playNextArpeggiatorNote() {
 /**
  * Füge eine Note zur Arpeggiator-Sequenz hinzu
  * - Fügt Note IMMER hinzu (erlaubt Duplikate für Folded Chords)
- * - Reference Count trackt wie oft die Tonhöhe insgesamt aktiv ist
+ * - Wie oft eine Tonhöhe klingt, zählt der Voice Allocator (MidiGenerator.h)
  */
 void addNoteToArpeggiatorMode(int note) {
   if (note < 0 || note >= 128) return;
@@ -372,14 +500,18 @@ void addNoteToArpeggiatorMode(int note) {
   // dass beim nächsten Beat-Trigger die erste Note (Index 0) spielt.
   if (numHeldArpeggiatorNotes == 0) {
     currentArpeggiatorIndex = -1; // Spezialwert für Start
+    
+    // Tastendruck kurz nach dem letzten Step-Trigger: diesen Step noch spielen
+    if (noteEventMicros != 0 && lastArpeggiatorTriggerMicros != 0) {
+      unsigned long lateMicros = noteEventMicros - lastArpeggiatorTriggerMicros;
+      unsigned long windowMicros = arpeggiatorStepDuration * (10UL * ARP_LATE_PRESS_PERCENT);
+      arpeggiatorCatchUp = (lateMicros < windowMicros);
+    }
   }
 
   // Füge Note hinzu
   heldArpeggiatorNotes[numHeldArpeggiatorNotes] = note;
   numHeldArpeggiatorNotes++;
-  
-  // Increment Reference Count (für Mapping-Logik)
-  arpNoteRefCount[note]++;
 }
 
 /**
@@ -398,14 +530,9 @@ void removeNoteFromArpeggiatorMode(int note) {
       }
       numHeldArpeggiatorNotes--;
       
-      // Update Reference Count
-      if (arpNoteRefCount[note] > 0) {
-        arpNoteRefCount[note]--;
-      }
-      
       // Wenn keine Noten mehr, schalte aktuelle Note aus
       if (numHeldArpeggiatorNotes == 0 && currentArpeggiatorPlayingNote >= 0 && currentArpeggiatorPlayingNote < 128) {
-        sendMidiNote(0x80, currentArpeggiatorPlayingNote, 0);
+        stopArpeggiatorNote();
         currentArpeggiatorPlayingNote = -1;
       }
       
@@ -441,16 +568,10 @@ void transposeArpeggiatorNotes(int semiTones) {
  * Clear all arpeggiator notes
  */
 void clearArpeggiatorNotes() {
-  if (arpeggiatorNoteIsOn && currentArpeggiatorPlayingNote >= 0) {
-    sendMidiNote(0x80, currentArpeggiatorPlayingNote, 0);
-  }
+  stopArpeggiatorNote();
   CLEAR_ARP_NOTES();
-  for (int i = 0; i < 128; i++) {
-    arpNoteRefCount[i] = 0;
-  }
   numHeldArpeggiatorNotes = 0;
   currentArpeggiatorPlayingNote = -1;
-  arpeggiatorNoteIsOn = false;
 }
 
 #endif
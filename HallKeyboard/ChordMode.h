@@ -6,19 +6,21 @@
  * - Folded Mode: Akkord-Noten in Oktave gefaltet
  * 
  * INPUT:
- *   - switch_triggered[] vom Hardware Controller
+ *   - keyPressedMask vom Hardware Controller
  *   - Grundton (MIDI Note)
  *   - scaleType, diatonicRootKey aus Software Controller
  *   - chordModeType (Extended/Folded)
  * 
  * OUTPUT:
  *   - chordModeMidiNotes[] - Welche Noten sollen vom Chord Mode gespielt werden
+ *   - Note Events (Layer BASS/CHORD) auf dem MIDI Event Bus
  */
 
 #ifndef CHORD_MODE_H
 #define CHORD_MODE_H
 
 #include <Adafruit_NeoPixel.h>
+#include "MidiEventBus.h"
 
 extern Adafruit_NeoPixel pixels;
 extern uint8_t activeMidiNotes[16];
@@ -91,7 +93,6 @@ const int8_t modeStepIntervals[7] PROGMEM = {2, 2, 1, 2, 2, 2, 1};  // Intervall
 // ============================================
 extern int8_t currentOctave;           // Aktuelle Oktave
 extern const uint8_t midiNotes[13];     // MIDI Notes für die Tasten
-extern void sendMidiNote(int cmd, int pitch, int velocity);
 
 // ============================================
 // CHORD MODE STATE
@@ -358,8 +359,8 @@ void turnOnChordNotesImpl(int switchIndex, bool isFolded) {
       }
       
       if (chordNote >= 0 && chordNote < 128) {
-        // Send MIDI Note On
-        sendMidiNote(0x90, chordNote, 0x45);
+        // Send MIDI Note On (Grundton auf dem Bass-Kanal)
+        postMidiEvent(midiNoteOnEvent(j == 0 ? MIDI_LAYER_BASS : MIDI_LAYER_CHORD, chordNote, 0x45));
         
         // Update LED für diese Note
         int displaySwitchIndex = (chordNote == (currentOctave + 1) * 12) ? 12 : (chordNote % 12);
@@ -397,7 +398,7 @@ void turnOffChordNotesImpl(int switchIndex, bool isFolded) {
       
       if (chordNote >= 0 && chordNote < 128) {
         // Send MIDI Note Off
-        sendMidiNote(0x90, chordNote, 0x00);
+        postMidiEvent(midiNoteOffEvent(j == 0 ? MIDI_LAYER_BASS : MIDI_LAYER_CHORD, chordNote));
         
         // Update LED für diese Note
         int displaySwitchIndex = (chordNote == (currentOctave + 1) * 12) ? 12 : (chordNote % 12);
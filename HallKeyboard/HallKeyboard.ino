@@ -47,6 +47,11 @@
 // ============================================
 #include "MidiGenerator.h"
 
+// ============================================
+// INCLUDE MIDI THRU LAYER (Soft-Thru / Merge)
+// ============================================
+#include "MidiThru.h"
+
 // ============================================
 // INCLUDE LED CONTROLLER LAYER (Physical Control)
 // ============================================
@@ -71,7 +76,7 @@
 void setup() {
   // Initialize Serial
   Serial.begin(115200);
-  Serial1.begin(31250);
+  initMidiUart(); // DIN MIDI (USART1, 31250 Baud)
   
   // Layer 1 Setup: Pins und Hardware
   setupHardwareController();
@@ -85,21 +90,24 @@ void setup() {
   
   // Lade Einstellungen aus EEPROM (überschreibt Defaults falls vorhanden)
   loadSettingsFromEEPROM();
+  loadKeyCalibrationFromEEPROM();
+  
+  // FS1 beim Einschalten gehalten: Kalibrier-Sweep der analogen Keys starten
+  if (scanKeyPorts() & (1UL << SCAN_KEY_FS_OFFSET)) {
+    startKeyCalibration();
+  }
   
   // Killall MIDI: Sicherstellen, dass keine Noten hängen (Bootup Panic)
+  // Läuft asynchron über den TX-Puffer, setup() wartet nicht darauf
   killAllMidiNotes();
   
   initLEDController();
   initLEDDisplay();
   initLEDAnimator();
   
-  // Bootup: Visual feedback
-  for (int led = 0; led < 8; led++) {
-    setLEDColor(led, COLOR_GREEN_IDX, 200);
-    syncLEDStrip();
-    delay(50);
-    turnOffLED(led);
-    syncLEDStrip();
+  // Bootup: Visual feedback (läuft in loop() weiter, Tasten sind sofort spielbar)
+  if (!analogKeyCalibrating) {
+    startBootAnimation();
   }
   
   // Tap Tempo initialisieren
@@ -109,6 +117,7 @@ void setup() {
   
   // MIDI Clock initialisieren
   initMidiClockReceiver(); // MIDI Clock Input Layer
+  initMidiThru();          // Soft-Thru des MIDI Eingangs
   initMidiClockGenerator();
   updateClockInterval(); // Berechnet Intervall für 120 BPM
   startMidiClock();       // Startet den Output
@@ -120,13 +129,28 @@ void loop() {
   // ============================================
   // MIDI CLOCK RECEIVER: Poll MIDI Input
   // ============================================
-  updateMidiClockReceiver(); // Liest Serial1 und prüft Timeout
+  updateMidiClockReceiver(); // Liest den MIDI RX-Puffer (Clock + Soft-Thru) und prüft Timeout
+  updateMidiThru();          // Stockender SysEx-Stream des Soft-Thru
   
   // ============================================
   // HARDWARE CONTROLLER LAYER: Lese Input
   // ============================================
   updateHardwareController();
   
+  // Kalibrier-Sweep läuft: keine Bedienung, Ergebnis nach Ablauf speichern
+  if (analogKeyCalibrating) {
+    if (updateKeyCalibration()) {
+      saveKeyCalibrationToEEPROM();
+      // Noch gehaltene Function Switches nicht als Short Press auswerten
+      for (int i = 0; i < NUM_FUNCTION_SWITCHES; i++) {
+        functionSwitchGesture[i] = IS_FS_HELD(i) ? FS_GESTURE_DONE : FS_GESTURE_IDLE;
+      }
+    }
+    updateLEDDisplay();
+    if (ledDirty) syncLEDStrip();
+    return;
+  }
+  
   // ============================================
   // SOFTWARE CONTROLLER LAYER: Update States & Events
   // ============================================
@@ -137,11 +161,14 @@ void loop() {
   // ============================================
   processNoteSwitches();
   
+  // Polyphonic Aftertouch der analogen Keys (bandbreitenbegrenzt)
+  processAftertouch();
+  
   // Update Tap Tempo (registriert die Tempo-Taps von FS4)
   // Tempo-Taps nur im Hauptmenü (nicht im Submenü) zulassen!
   // Trigger-Logik (Phase Reset / Downbeat Sync) wird jetzt in SoftwareController.h gehandelt.
   if (!inSubmenu && !midiClockActive) {
-    tapTempo.update(functionSwitches[3].isDown());
+    tapTempo.update(IS_FS_HELD(3));
   } else {
     // Im Submenü oder bei MIDI Clock: Button-Input für Tap-Tempo ignorieren
     tapTempo.update(false);
@@ -151,7 +178,7 @@ void loop() {
   // Prüfe sowohl TapTempo als auch MIDI Clock Input
   static float lastBpmForSystem = 0;
   bool isExternal = midiClockActive;
-  float currentBpm = isExternal ? (float)calculatedBPM : tapTempo.getBPM();
+  float currentBpm = isExternal ? midiClockBpmX100 / 100.0 : tapTempo.getBPM();
   
   if (abs(currentBpm - lastBpmForSystem) > 0.1) {
     if (isExternal) {
@@ -174,15 +201,75 @@ void loop() {
   // UPDATE LED LAYERS
   // ============================================
   
-  // Layer 2: Intelligent Display Manager
-  // Handles ALL states: Notes, Idle, Submenu
-  updateLEDDisplay();
-  
-  // Layer 2: Update Visual Effects (wie animieren)
-  updateLEDAnimations();      // Animate Blinks/Pulses
+  // Boot-Lauflicht hat in den ersten 400 ms Vorrang (bis eine Taste gedrückt wird)
+  if (!updateBootAnimation()) {
+    // Layer 2: Intelligent Display Manager
+    // Handles ALL states: Notes, Idle, Submenu
+    updateLEDDisplay();
+    
+    // Layer 2: Update Visual Effects (wie animieren)
+    updateLEDAnimations();      // Animate Blinks/Pulses
+  }
   
   // Layer 3: Sync mit Hardware
   if (ledDirty) {
     syncLEDStrip();           // Sync zu NeoPixel Hardware
   }
+  
+  // USB-MIDI: Pakete dieses Durchlaufs gesammelt senden (max. einmal pro USB-Frame)
+  flushUsbMidi();
+  
+#ifdef MIDI_CLOCK_JITTER_REPORT
+  // Debug: Timing der Clock-Ausgabe und des Clock-Eingangs alle 5 s über USB Serial (µs)
+  static unsigned long lastJitterReport = 0;
+  if (millis() - lastJitterReport >= 5000) {
+    lastJitterReport = millis();
+    if (midiClockTxStats.count > 0) {
+      Serial.print("Clock TX delay avg/max: ");
+      Serial.print(midiClockTxStats.sumDelay / midiClockTxStats.count);
+      Serial.print("/");
+      Serial.print(midiClockTxStats.maxDelay);
+      Serial.print(" interval err max: ");
+      Serial.println(midiClockTxStats.maxIntervalError);
+      resetMidiClockTxStats();
+    }
+    // Jitter mit ISR-Zeitstempel vs. Zeitstempel beim Auslesen in loop()
+    if (midiClockRxStats.count > 0) {
+      Serial.print("Clock RX jitter avg/max isr: ");
+      Serial.print(midiClockRxStats.sumJitter / midiClockRxStats.count);
+      Serial.print("/");
+      Serial.print(midiClockRxStats.maxJitter);
+      Serial.print(" loop: ");
+      Serial.print(midiClockRxStats.sumLoopJitter / midiClockRxStats.count);
+      Serial.print("/");
+      Serial.print(midiClockRxStats.maxLoopJitter);
+      Serial.print(" latency max: ");
+      Serial.println(midiClockRxStats.maxLatency);
+      resetMidiClockRxStats();
+    }
+  }
+#endif
+
+#ifdef MIDI_BANDWIDTH_REPORT
+  // Debug: Auslastung der DIN-Leitung jede Sekunde über USB Serial
+  static unsigned long lastBandwidthReport = 0;
+  if (millis() - lastBandwidthReport >= 1000) {
+    lastBandwidthReport = millis();
+    Serial.print("MIDI out B/s cur/peak: ");
+    Serial.print(midiBandwidthStats.bytesPerSec);
+    Serial.print("/");
+    Serial.print(midiBandwidthStats.peakBytesPerSec);
+    Serial.print(" queue cur/peak: ");
+    Serial.print(midiBandwidthStats.queueDepth);
+    Serial.print("/");
+    Serial.print(midiBandwidthStats.peakQueueDepth);
+    Serial.print(" AT dropped: ");
+    Serial.print(midiBandwidthStats.droppedAftertouch);
+    Serial.print(" CC coalesced: ");
+    Serial.print(midiBandwidthStats.coalescedControllers);
+    Serial.print(" shaping: ");
+    Serial.println(midiShapingActive ? 1 : 0);
+    resetMidiBandwidthStats();
+  }
+#endif
 }
@@ -6,18 +6,23 @@
  * - Liest Function Switches (FS1-FS4)
  * - Gibt Events weiter an andere Layer
  * 
- * INPUT: Raw Sensor Values von Arduino Pins
- * OUTPUT: 
- *   - switch_triggered[] - welche Switches gerade gedrückt wurden (einmaliger Trigger)
- *   - switch_released[] - welche Switches gerade losgelassen wurden
- *   - switch_held[] - welche Switches gerade gehalten sind
+ * INPUT: Raw Sensor Values von Arduino Pins (Port-Snapshot via KeyScanner.h,
+ *        lineare Hall-Sensoren via AnalogKeyScanner.h)
+ * OUTPUT (Bitmasken, Bit i = Scan-Index i, Bits 13-16 = FS1-FS4):
+ *   - keyPressedMask - welche Switches gerade gedrückt wurden (einmaliger Trigger)
+ *   - keyReleasedMask - welche Switches gerade losgelassen wurden
+ *   - keyHeldMask - welche Switches gerade gehalten sind
+ *   Zugriff über IS_SWITCH_TRIGGERED(i) / IS_SWITCH_RELEASED(i) / IS_SWITCH_HELD(i)
+ *   bzw. IS_FS_TRIGGERED(i) / IS_FS_RELEASED(i) / IS_FS_HELD(i)
+ *   - switchVelocity[] - Velocity des letzten Press pro Note-Switch
  */
 
 #ifndef HARDWARE_CONTROLLER_H
 #define HARDWARE_CONTROLLER_H
 
-#include "button.h"
 #include "arduino_stubs.h"
+#include "KeyScanner.h"
+#include "AnalogKeyScanner.h"
 #include <avr/pgmspace.h>
 
 // ============================================
@@ -54,94 +59,170 @@ const uint8_t functionSwitchPins[NUM_FUNCTION_SWITCHES] PROGMEM = {
 };
 
 const unsigned long LONG_PRESS_DURATION = 1000;
+const unsigned long DOUBLE_TAP_WINDOW = 300;   // Max. Abstand Release -> zweiter Press
+
+// Gesten-Zustand pro Function Switch (Auswertung in SoftwareController.h)
+#define FS_GESTURE_IDLE       0
+#define FS_GESTURE_PRESSED    1   // Gedrückt, Short-Action wartet auf Release
+#define FS_GESTURE_COMMITTED  2   // Gedrückt, Short-Action bereits ausgeführt (Rollback bei Long Press)
+#define FS_GESTURE_DONE       3   // Geste abgeschlossen, nur noch auf Release warten
+#define FS_GESTURE_TAPPED     4   // Losgelassen, Double-Tap Fenster offen
+
+// Debounce-Modus pro Switch-Gruppe
+// DEFERRED: Press und Release erst nach 16 stabilen Samples (4 ms)
+// EAGER:    Press sofort bei der ersten Flanke, danach 2 ms Hold-off,
+//           nur der Release wird voll entprellt (Hall-Switches prellen kaum)
+#define DEBOUNCE_MODE_DEFERRED 0
+#define DEBOUNCE_MODE_EAGER    1
+
+#ifndef NOTE_SWITCH_DEBOUNCE_MODE
+#define NOTE_SWITCH_DEBOUNCE_MODE DEBOUNCE_MODE_EAGER
+#endif
+#ifndef FUNCTION_SWITCH_DEBOUNCE_MODE
+#define FUNCTION_SWITCH_DEBOUNCE_MODE DEBOUNCE_MODE_DEFERRED
+#endif
+
+// Note-Switches mit linearem Hall-Sensor (Bit i = Switch i).
+// Nur Pins mit ADC-Kanal möglich (D4, D6, D8, D9, D10, D12, D18), siehe AnalogKeyScanner.h
+#ifndef ANALOG_KEY_MASK
+#define ANALOG_KEY_MASK 0x0000
+#endif
+
+// Rapid Trigger für analoge Keys (Re-Trigger bei Richtungswechsel, siehe AnalogKeyScanner.h)
+#ifndef ANALOG_RAPID_TRIGGER
+#define ANALOG_RAPID_TRIGGER false
+#endif
+
+// Velocity für digitale Switches
+#define DEFAULT_NOTE_VELOCITY 0x45
+
+// Scan-Index Masken der Switch-Gruppen
+#define NOTE_SWITCH_SCAN_MASK ((1UL << NUM_SWITCHES) - 1)
+#define FUNCTION_SWITCH_SCAN_MASK (((1UL << NUM_FUNCTION_SWITCHES) - 1) << SCAN_KEY_FS_OFFSET)
 
 // ============================================
 // HARDWARE CONTROLLER STATE
 // ============================================
 
-// Button-Objekte
-extern Button switches[NUM_SWITCHES];
-extern Button functionSwitches[NUM_FUNCTION_SWITCHES];
+// Events für diesen Frame (Note-Switches + Function Switches in einer Maske)
+extern uint32_t keyPressedMask;
+extern uint32_t keyReleasedMask;
+extern uint32_t keyHeldMask;
+
+#define IS_SWITCH_TRIGGERED(i) ((keyPressedMask >> (i)) & 1)
+#define IS_SWITCH_RELEASED(i) ((keyReleasedMask >> (i)) & 1)
+#define IS_SWITCH_HELD(i) ((keyHeldMask >> (i)) & 1)
+#define IS_FS_TRIGGERED(i) IS_SWITCH_TRIGGERED(SCAN_KEY_FS_OFFSET + (i))
+#define IS_FS_RELEASED(i) IS_SWITCH_RELEASED(SCAN_KEY_FS_OFFSET + (i))
+#define IS_FS_HELD(i) IS_SWITCH_HELD(SCAN_KEY_FS_OFFSET + (i))
 
-// Events für diesen Frame
-extern bool switch_triggered[NUM_SWITCHES];
-extern bool switch_released[NUM_SWITCHES];
-extern bool switch_held[NUM_SWITCHES];
+// Velocity pro Note-Switch (analog gemessen oder DEFAULT_NOTE_VELOCITY)
+extern uint8_t switchVelocity[NUM_SWITCHES];
+
+// Zeitstempel (micros, vom Scanner erfasst) des letzten Press/Release pro Note-Switch
+extern unsigned long switchEventMicros[NUM_SWITCHES];
 
 // Function Switch State
 extern unsigned long functionSwitchPressTime[NUM_FUNCTION_SWITCHES];
 extern unsigned long functionSwitchPressMicros[NUM_FUNCTION_SWITCHES];
-extern bool functionSwitchLongPressed[NUM_FUNCTION_SWITCHES];
+extern uint8_t functionSwitchGesture[NUM_FUNCTION_SWITCHES];
 
 // Externals defined elsewhere
 extern int8_t currentOctave;
 
 // ============================================
-// HARDWARE CONTROLLER: Buttons & Pins (Actual Instance)
+// HARDWARE CONTROLLER: Switch State (Actual Instance)
 // ============================================
 
-// Wir definieren die Instanzen hier, falls sie nirgendwo sonst definiert sind.
-// Da wir sie aus der .ino entfernen, werden sie hier angelegt.
-Button switches[NUM_SWITCHES];
-Button functionSwitches[NUM_FUNCTION_SWITCHES];
-bool switch_triggered[NUM_SWITCHES];
-bool switch_released[NUM_SWITCHES];
-bool switch_held[NUM_SWITCHES];
+uint32_t keyPressedMask = 0;
+uint32_t keyReleasedMask = 0;
+uint32_t keyHeldMask = 0;
+uint8_t switchVelocity[NUM_SWITCHES];
+unsigned long switchEventMicros[NUM_SWITCHES];
+uint16_t analogSwitchMask = 0;
 unsigned long functionSwitchPressTime[NUM_FUNCTION_SWITCHES];
 unsigned long functionSwitchPressMicros[NUM_FUNCTION_SWITCHES];
-bool functionSwitchLongPressed[NUM_FUNCTION_SWITCHES];
+uint8_t functionSwitchGesture[NUM_FUNCTION_SWITCHES];
 
 // ============================================
 // HARDWARE CONTROLLER UPDATE & SETUP
 // ============================================
 
 /**
- * Initialisiere alle Pins und Buttons
+ * Initialisiere alle Pins und startet den Key Scanner
  */
 void setupHardwareController() {
-  // Alle Switch-Pins initialisieren
+  // Analoge Keys zuerst, damit der digitale Scanner sie ignorieren kann
+  analogSwitchMask = initAnalogKeyScanner(ANALOG_KEY_MASK);
+  setAnalogRapidTrigger(ANALOG_RAPID_TRIGGER);
+  
+  // Alle Switch-Pins initialisieren (analoge Hall-Sensoren ohne Pullup)
   for (int i = 0; i < NUM_SWITCHES; i++) {
-    switches[i].begin(pgm_read_byte(&switchPins[i]));
-    switch_triggered[i] = false;
-    switch_released[i] = false;
-    switch_held[i] = false;
+    bool isAnalog = analogSwitchMask & (1 << i);
+    pinMode(pgm_read_byte(&switchPins[i]), isAnalog ? INPUT : INPUT_PULLUP);
+    switchVelocity[i] = DEFAULT_NOTE_VELOCITY;
   }
   
-  // Analog Pins als Digital mit Pullup konfigurieren
-  pinMode(A1, INPUT_PULLUP);
-  pinMode(A2, INPUT_PULLUP);
-  pinMode(A3, INPUT_PULLUP);
-  pinMode(A4, INPUT_PULLUP);
-  
-  // Funktions-Schalter initialisieren
+  // Funktions-Schalter (Analog Pins als Digital mit Pullup)
   for (int i = 0; i < NUM_FUNCTION_SWITCHES; i++) {
-    switches[i].begin(pgm_read_byte(&switchPins[i])); // This was wrong in the original too? Wait.
-    // The original code used A1, A2, A3, A4 directly.
-    functionSwitches[i].begin(pgm_read_byte(&functionSwitchPins[i]));
-    functionSwitchLongPressed[i] = false;
+    pinMode(pgm_read_byte(&functionSwitchPins[i]), INPUT_PULLUP);
+    functionSwitchGesture[i] = FS_GESTURE_IDLE;
     functionSwitchPressTime[i] = 0;
+    functionSwitchPressMicros[i] = 0;
   }
+  
+  // Timer-gesteuerter Scan (Debounce läuft im ISR)
+  uint32_t eagerMask = 0;
+  if (NOTE_SWITCH_DEBOUNCE_MODE == DEBOUNCE_MODE_EAGER) eagerMask |= NOTE_SWITCH_SCAN_MASK;
+  if (FUNCTION_SWITCH_DEBOUNCE_MODE == DEBOUNCE_MODE_EAGER) eagerMask |= FUNCTION_SWITCH_SCAN_MASK;
+  initKeyScanner(eagerMask, analogSwitchMask);
 }
 
 /**
  * Aktualisiere Hardware-Input für diesen Frame
+ * Leert die Event-FIFO des Key Scanners. Pro Switch wird höchstens ein Event
+ * pro Frame übernommen, damit Press+Release nicht in falscher Reihenfolge landen.
+ * Weitere Events bleiben für den nächsten Frame in der FIFO.
  */
 void updateHardwareController() {
   // Setze alle Events für diesen Frame zurück
-  for (int i = 0; i < NUM_SWITCHES; i++) {
-    switch_triggered[i] = false;
-    switch_released[i] = false;
-  }
+  keyPressedMask = 0;
+  keyReleasedMask = 0;
   
-  // Aktualisiere alle Note-Switches
-  for (int i = 0; i < NUM_SWITCHES; i++) {
-    if (switches[i].trigger()) {
-      switch_triggered[i] = true;
-      switch_held[i] = true;
+  KeyEvent event;
+  while (peekKeyEvent(event)) {
+    uint32_t keyBit = 1UL << event.key;
+    if ((keyPressedMask | keyReleasedMask) & keyBit) break; // Rest im nächsten Frame
+    dropKeyEvent();
+    if (event.key < NUM_SWITCHES) switchEventMicros[event.key] = event.micros;
+    
+    if (event.pressed) {
+      keyPressedMask |= keyBit;
+      keyHeldMask |= keyBit;
+      if (event.key >= SCAN_KEY_FS_OFFSET) {
+        functionSwitchPressMicros[event.key - SCAN_KEY_FS_OFFSET] = event.micros;
+      }
+    } else {
+      keyReleasedMask |= keyBit;
+      keyHeldMask &= ~keyBit;
     }
-    else if (switches[i].released()) {
-      switch_released[i] = true;
-      switch_held[i] = false;
+  }
+  
+  // Analoge Keys (gleiche Regel: ein Event pro Switch und Frame)
+  AnalogKeyEvent analogEvent;
+  while (peekAnalogKeyEvent(analogEvent)) {
+    uint32_t keyBit = 1UL << analogEvent.key;
+    if ((keyPressedMask | keyReleasedMask) & keyBit) break;
+    dropAnalogKeyEvent();
+    switchEventMicros[analogEvent.key] = analogEvent.micros;
+    
+    if (analogEvent.pressed) {
+      keyPressedMask |= keyBit;
+      keyHeldMask |= keyBit;
+      switchVelocity[analogEvent.key] = travelToVelocity(analogEvent.travelMicros);
+    } else {
+      keyReleasedMask |= keyBit;
+      keyHeldMask &= ~keyBit;
     }
   }
 }
@@ -6,7 +6,7 @@
  * - Additive Mode: Mehrere Noten gleichzeitig
  * 
  * INPUT:
- *   - switch_triggered[], switch_released[] vom Hardware Controller
+ *   - keyPressedMask, keyReleasedMask vom Hardware Controller
  *   - playModeType aus Software Controller
  *   - MIDI Note (von Hardware Controller)
  * 
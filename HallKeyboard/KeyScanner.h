@@ -0,0 +1,270 @@
+/**
+ * KEY SCANNER (Port-Level Scan Engine)
+ *
+ * Liest alle Switches mit einem Zugriff pro Port statt per digitalRead():
+ * - PINB/PINC/PIND/PINE/PINF werden genau einmal pro Scan gelesen
+ * - 13 Note-Switches + 4 Function Switches werden in eine Bitmaske gepackt
+ * - Port/Bit-Zuordnung als PROGMEM Tabelle (abgeleitet aus switchPins[] / functionSwitchPins[])
+ * - Timer3 ISR scannt mit fester Rate (4 kHz), unabhängig von der loop()-Last
+ * - Debounce im ISR als vertikaler Zähler: alle 17 Switches parallel mit
+ *   wenigen AND/XOR Operationen auf 32-Bit Worten
+ * - Optionaler Eager-Modus pro Switch: Press feuert bei der ersten Flanke,
+ *   danach Hold-off (Lockout) gegen Prellen, nur der Release wird entprellt
+ * - Press/Release Events mit micros() Zeitstempel in einer
+ *   lock-free Single-Producer/Single-Consumer FIFO
+ *
+ * INPUT: Port-Register des ATmega32U4 (Arduino Leonardo)
+ * OUTPUT:
+ *   - keyEventFifo[] - Events (Switch-Index, gedrückt/losgelassen, Zeitstempel)
+ *   - keyStableMask - Entprellter Zustand, Bit i gesetzt = Switch i gedrückt
+ *     Bits 0-12: Note-Switches, Bits 13-16: FS1-FS4
+ */
+
+#ifndef KEY_SCANNER_H
+#define KEY_SCANNER_H
+
+#include "arduino_stubs.h"
+#include <avr/pgmspace.h>
+
+// ============================================
+// SCAN MAP (Leonardo Pin -> Port/Bit)
+// ============================================
+
+#define NUM_SCAN_KEYS        17
+#define SCAN_KEY_FS_OFFSET   13     // Erstes Function-Switch-Bit im Snapshot
+
+// Port-Indizes in keyScanPorts[]
+#define SCAN_PORT_B 0
+#define SCAN_PORT_C 1
+#define SCAN_PORT_D 2
+#define SCAN_PORT_E 3
+#define SCAN_PORT_F 4
+#define NUM_SCAN_PORTS 5
+
+// Kodierung: High-Nibble = Port-Index, Low-Nibble = Bit-Nummer
+#define SCAN_ENTRY(port, bit) (uint8_t)(((port) << 4) | (bit))
+
+// Muss synchron zu switchPins[] und functionSwitchPins[] (HardwareController.h) bleiben!
+const uint8_t keyScanMap[NUM_SCAN_KEYS] PROGMEM = {
+  SCAN_ENTRY(SCAN_PORT_D, 1),  // D2
+  SCAN_ENTRY(SCAN_PORT_D, 0),  // D3
+  SCAN_ENTRY(SCAN_PORT_D, 4),  // D4
+  SCAN_ENTRY(SCAN_PORT_C, 6),  // D5
+  SCAN_ENTRY(SCAN_PORT_D, 7),  // D6
+  SCAN_ENTRY(SCAN_PORT_E, 6),  // D7
+  SCAN_ENTRY(SCAN_PORT_B, 4),  // D8
+  SCAN_ENTRY(SCAN_PORT_B, 5),  // D9
+  SCAN_ENTRY(SCAN_PORT_B, 6),  // D10
+  SCAN_ENTRY(SCAN_PORT_B, 7),  // D11
+  SCAN_ENTRY(SCAN_PORT_D, 6),  // D12
+  SCAN_ENTRY(SCAN_PORT_C, 7),  // D13
+  SCAN_ENTRY(SCAN_PORT_F, 7),  // D18
+  SCAN_ENTRY(SCAN_PORT_F, 6),  // A1 (FS1)
+  SCAN_ENTRY(SCAN_PORT_F, 5),  // A2 (FS2)
+  SCAN_ENTRY(SCAN_PORT_F, 4),  // A3 (FS3)
+  SCAN_ENTRY(SCAN_PORT_F, 1)   // A4 (FS4)
+};
+
+// ============================================
+// SCAN TIMER & DEBOUNCE CONFIG
+// ============================================
+
+#define KEY_SCAN_RATE_HZ       4000
+#define KEY_VCOUNT_BITS        4        // Bits pro vertikalem Zähler
+#define KEY_DEBOUNCE_SAMPLES   (1 << KEY_VCOUNT_BITS) // 16 Samples @ 4 kHz = 4 ms stabil
+#define KEY_LOCKOUT_BITS       3        // Bits pro Lockout-Zähler
+#define KEY_LOCKOUT_SAMPLES    (1 << KEY_LOCKOUT_BITS) // 8 Samples @ 4 kHz = 2 ms Hold-off (Eager-Modus)
+#define KEY_EVENT_FIFO_SIZE    16       // Muss eine Zweierpotenz sein
+
+// ============================================
+// KEY SCANNER STATE
+// ============================================
+
+struct KeyEvent {
+  uint8_t key;            // Scan-Index (0-12 Note, 13-16 FS)
+  bool pressed;           // true = gedrückt, false = losgelassen
+  unsigned long micros;   // Zeitpunkt der ersten Flanke
+};
+
+volatile uint32_t keyScanSnapshot = 0;
+volatile uint32_t keyStableMask = 0;
+uint32_t keyVCount[KEY_VCOUNT_BITS];    // Bit-Ebene k des Zählers aller Switches
+uint32_t keyEagerMask = 0;              // Switches im Eager-Modus
+uint32_t keyAnalogMask = 0;             // Switches, die der ADC-Scanner liest (hier ignoriert)
+uint32_t keyLockoutMask = 0;            // Switches im Hold-off nach einem Eager-Event
+uint32_t keyLockCount[KEY_LOCKOUT_BITS];
+unsigned long keyEdgeMicros[NUM_SCAN_KEYS];
+
+KeyEvent keyEventFifo[KEY_EVENT_FIFO_SIZE];
+volatile uint8_t keyEventHead = 0;      // Nur vom ISR geschrieben
+volatile uint8_t keyEventTail = 0;      // Nur von loop() geschrieben
+volatile uint8_t keyEventOverflows = 0; // Diagnose: verlorene Events
+
+// ============================================
+// KEY SCANNER FUNCTIONS
+// ============================================
+
+/**
+ * Liest alle Ports einmal und packt den Zustand aller Switches in eine Bitmaske.
+ * Die Pins müssen bereits als INPUT_PULLUP konfiguriert sein (aktiv LOW).
+ */
+uint32_t scanKeyPorts() {
+  uint8_t keyScanPorts[NUM_SCAN_PORTS];
+  keyScanPorts[SCAN_PORT_B] = PINB;
+  keyScanPorts[SCAN_PORT_C] = PINC;
+  keyScanPorts[SCAN_PORT_D] = PIND;
+  keyScanPorts[SCAN_PORT_E] = PINE;
+  keyScanPorts[SCAN_PORT_F] = PINF;
+
+  uint32_t pressed = 0;
+  for (uint8_t i = 0; i < NUM_SCAN_KEYS; i++) {
+    uint8_t entry = pgm_read_byte(&keyScanMap[i]);
+    if (!(keyScanPorts[entry >> 4] & (1 << (entry & 0x0F)))) {
+      pressed |= (1UL << i);
+    }
+  }
+
+  keyScanSnapshot = pressed;
+  return pressed;
+}
+
+/**
+ * Legt ein Event in die FIFO (nur aus dem ISR aufrufen)
+ */
+inline void pushKeyEvent(uint8_t key, bool pressed, unsigned long timestamp) {
+  uint8_t next = (keyEventHead + 1) & (KEY_EVENT_FIFO_SIZE - 1);
+  if (next == keyEventTail) {
+    keyEventOverflows++;
+    return;
+  }
+  keyEventFifo[keyEventHead].key = key;
+  keyEventFifo[keyEventHead].pressed = pressed;
+  keyEventFifo[keyEventHead].micros = timestamp;
+  keyEventHead = next; // Erst nach dem Schreiben veröffentlichen
+}
+
+/**
+ * Schaut das nächste Event an, ohne es zu entfernen (nur aus loop())
+ */
+inline bool peekKeyEvent(KeyEvent &event) {
+  uint8_t tail = keyEventTail;
+  if (tail == keyEventHead) return false;
+  event = keyEventFifo[tail];
+  return true;
+}
+
+/**
+ * Entfernt das zuletzt mit peekKeyEvent() gelesene Event (nur aus loop())
+ */
+inline void dropKeyEvent() {
+  keyEventTail = (keyEventTail + 1) & (KEY_EVENT_FIFO_SIZE - 1);
+}
+
+/**
+ * Scan-Tick: Ports lesen und alle Switches parallel entprellen.
+ *
+ * Vertikaler Zähler: Spalte i über keyVCount[0..3] ist der 4-Bit Zähler von Switch i.
+ * - Raw == stabiler Zustand -> Zähler zurück auf 15
+ * - Raw != stabiler Zustand -> Zähler dekrementieren
+ * - Unterlauf (nach KEY_DEBOUNCE_SAMPLES gleichen Samples) -> Zustandswechsel
+ *
+ * Eager-Switches übernehmen einen Press sofort und ignorieren den Pin danach
+ * für KEY_LOCKOUT_SAMPLES (gleicher vertikaler Zähler-Trick in keyLockCount[]).
+ * Der Zeitstempel eines Events ist der der ersten Flanke.
+ */
+ISR(TIMER3_COMPA_vect) {
+  uint32_t raw = scanKeyPorts() & ~keyAnalogMask;
+
+  // Hold-off der gesperrten Switches herunterzählen
+  uint32_t lockBorrow = keyLockoutMask;
+  for (uint8_t k = 0; k < KEY_LOCKOUT_BITS; k++) {
+    uint32_t c = keyLockCount[k];
+    keyLockCount[k] = c ^ lockBorrow;
+    lockBorrow &= ~c;
+  }
+  keyLockoutMask &= ~lockBorrow;
+
+  uint32_t delta = (raw ^ keyStableMask) & ~keyLockoutMask;
+
+  // Eager: Press bei der ersten Flanke ohne Debounce übernehmen
+  uint32_t eager = delta & raw & keyEagerMask;
+  delta &= ~eager;
+
+  // Zähler steht noch auf 15 -> erste abweichende Probe, Zeitstempel merken
+  uint32_t started = delta;
+  for (uint8_t k = 0; k < KEY_VCOUNT_BITS; k++) started &= keyVCount[k];
+  started |= eager;
+
+  // Ripple-Decrement über alle Spalten gleichzeitig
+  uint32_t borrow = delta;
+  for (uint8_t k = 0; k < KEY_VCOUNT_BITS; k++) {
+    uint32_t c = keyVCount[k];
+    keyVCount[k] = (c ^ borrow) | ~delta;
+    borrow &= ~c;
+  }
+  uint32_t toggle = borrow | eager;
+
+  if (started) {
+    unsigned long now = micros();
+    for (uint8_t i = 0; i < NUM_SCAN_KEYS; i++) {
+      if (started & (1UL << i)) keyEdgeMicros[i] = now;
+    }
+  }
+
+  if (toggle) {
+    keyStableMask ^= toggle;
+
+    // Eager-Switches nach jedem Wechsel (Press und Release) sperren
+    uint32_t lock = toggle & keyEagerMask;
+    if (lock) {
+      keyLockoutMask |= lock;
+      for (uint8_t k = 0; k < KEY_LOCKOUT_BITS; k++) keyLockCount[k] |= lock;
+    }
+
+    for (uint8_t i = 0; i < NUM_SCAN_KEYS; i++) {
+      uint32_t bitMask = 1UL << i;
+      if (toggle & bitMask) {
+        pushKeyEvent(i, (raw & bitMask) != 0, keyEdgeMicros[i]);
+      }
+    }
+  }
+}
+
+/**
+ * Startet Timer3 im CTC Mode als fester Scan-Takt
+ * 16MHz / 8 Prescaler = 2MHz -> OCR3A = 2MHz / 4kHz - 1 = 499
+ *
+ * eagerMask: Switches (Scan-Index Bits), die im Eager-Modus laufen
+ * analogMask: Switches, die analog gelesen werden und hier ignoriert werden
+ */
+void initKeyScanner(uint32_t eagerMask, uint32_t analogMask) {
+  for (uint8_t k = 0; k < KEY_VCOUNT_BITS; k++) {
+    keyVCount[k] = 0xFFFFFFFFUL;
+  }
+  for (uint8_t k = 0; k < KEY_LOCKOUT_BITS; k++) {
+    keyLockCount[k] = 0;
+  }
+  keyEagerMask = eagerMask;
+  keyAnalogMask = analogMask;
+  keyLockoutMask = 0;
+  for (uint8_t i = 0; i < NUM_SCAN_KEYS; i++) {
+    keyEdgeMicros[i] = 0;
+  }
+  keyEventHead = 0;
+  keyEventTail = 0;
+  keyEventOverflows = 0;
+
+  keyStableMask = 0; // Wie Button::begin(): alle Switches starten als nicht gedrückt
+
+  cli();
+  TCCR3A = 0;
+  TCCR3B = 0;
+  TCNT3  = 0;
+  OCR3A  = (F_CPU / 8 / KEY_SCAN_RATE_HZ) - 1;
+  TCCR3B |= (1 << WGM32);   // CTC Mode
+  TCCR3B |= (1 << CS31);    // Prescaler 8
+  TIMSK3 |= (1 << OCIE3A);  // Enable Compare A Interrupt
+  sei();
+}
+
+#endif
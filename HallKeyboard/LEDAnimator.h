@@ -12,6 +12,8 @@
 
 extern Adafruit_NeoPixel pixels;
 extern volatile bool midiClockActive; // From MidiClockReceiver
+extern volatile bool midiClockRunning; // From MidiClockGenerator
+extern uint32_t getClockPhase();
 
 // ============================================
 // LED ANIMATOR STATE
@@ -31,12 +33,18 @@ const unsigned long LED_BLINK_INTERVAL = 250;
 // Tap Tempo LED State
 unsigned long lastTapTempoLEDTime = 0;
 bool tapTempoLEDState = false;
+uint8_t lastTapTempoLEDBeat = 0;
 
 // Error LED State
 int8_t errorLEDIndex = -1;
 unsigned long errorLEDStartTime = 0;
 const unsigned long ERROR_LED_DURATION = 200;
 
+// Boot Animation State (Lauflicht, non-blocking)
+int8_t bootAnimationStep = -1;   // -1 = aus
+unsigned long bootAnimationTime = 0;
+const unsigned long BOOT_ANIMATION_STEP = 50;
+
 // External variables for animation logic
 extern bool isIdle;
 extern bool inSubmenu;
@@ -46,7 +54,6 @@ extern ArduinoTapTempo tapTempo;
 extern bool heldNotes[NUM_SWITCHES];
 extern const uint8_t ledMapping[NUM_SWITCHES];
 extern const bool isBlackKey[NUM_SWITCHES];
-extern Button switches[NUM_SWITCHES];
 
 /**
  * Initialisiere
@@ -55,6 +62,41 @@ void initLEDAnimator() {
   //Serial.println("LED Animator init");
 }
 
+/**
+ * Startet das Boot-Lauflicht (grün über LED 0-7)
+ */
+void startBootAnimation() {
+  bootAnimationStep = 0;
+  bootAnimationTime = millis();
+  setLEDColor(0, COLOR_GREEN_IDX, 200);
+}
+
+/**
+ * Update Boot-Lauflicht (non-blocking, 50 ms pro LED)
+ * Rückgabe: true solange die Animation die LEDs belegt.
+ * Sobald eine Taste gedrückt wird, bricht sie zugunsten der Noten-Anzeige ab.
+ */
+bool updateBootAnimation() {
+  if (bootAnimationStep < 0) return false;
+  
+  if (keyHeldMask != 0) {
+    turnOffLED(bootAnimationStep);
+    bootAnimationStep = -1;
+    return false;
+  }
+  
+  if (millis() - bootAnimationTime < BOOT_ANIMATION_STEP) return true;
+  bootAnimationTime += BOOT_ANIMATION_STEP;
+  
+  turnOffLED(bootAnimationStep);
+  if (++bootAnimationStep >= 8) {
+    bootAnimationStep = -1;
+    return false;
+  }
+  setLEDColor(bootAnimationStep, COLOR_GREEN_IDX, 200);
+  return true;
+}
+
 /**
  * Update Error-LED Blinken (non-blocking)
  */
@@ -89,7 +131,18 @@ void updateTapTempoLED() {
     return;
   }
 
-  bool beatHappened = tapTempo.onBeat();
+  // Mit Clock: Beat aus der Clock-Phase (gleiche Basis wie der Arp), sonst Tap Tempo
+  bool clocked = midiClockRunning || midiClockActive;
+  uint32_t phase = 0;
+  bool beatHappened;
+  if (clocked) {
+    phase = getClockPhase();
+    uint8_t beat = phase / CLOCK_PHASE_PPQN;
+    beatHappened = (beat != lastTapTempoLEDBeat);
+    lastTapTempoLEDBeat = beat;
+  } else {
+    beatHappened = tapTempo.onBeat();
+  }
   if (beatHappened && bpmPriorityBeats > 0) {
     bpmPriorityBeats--;
   }
@@ -125,8 +178,10 @@ void updateTapTempoLED() {
   
   const unsigned long PULSE_DURATION = 100;
   unsigned long timeSinceBeat = currentTime - lastTapTempoLEDTime;
+  // Mit Clock: Puls über das erste Fünftel des Beats (ca. 100 ms bei 120 BPM)
+  bool pulseOver = clocked ? (phase % CLOCK_PHASE_PPQN >= CLOCK_PHASE_PPQN / 5) : (timeSinceBeat >= PULSE_DURATION);
   
-  if (tapTempoLEDState && timeSinceBeat >= PULSE_DURATION) {
+  if (tapTempoLEDState && pulseOver) {
     tapTempoLEDState = false;
     // Wenn wir nicht im Idle-Mode sind, duerfen wir die LED nicht aktiv AUS schalten,
     // da sonst die Note Layer (LEDDisplay.h) geflackert wird.
@@ -161,7 +216,7 @@ void updateLEDMultiNoteBlink() {
       int activeCount = 0;
       int activeSwitches[2];
       for (int i = 0; i < NUM_SWITCHES; i++) {
-        if (pgm_read_byte(&ledMapping[i]) == ledIndex && switches[i].isDown()) {
+        if (pgm_read_byte(&ledMapping[i]) == ledIndex && IS_SWITCH_HELD(i)) {
           if (activeCount < 2) {
             activeSwitches[activeCount] = i;
           }
@@ -27,6 +27,7 @@ extern int8_t submenuIndex;
 extern int8_t maxSubmenuIndex;
 extern uint8_t bpmPriorityBeats;
 extern int8_t confirmationSwitchIndex;
+extern volatile bool analogKeyCalibrating;
 
 #define IS_NOTE_ACTIVE(n) ((activeMidiNotes[(n) >> 3] >> ((n) & 7)) & 1)
 
@@ -68,6 +69,15 @@ void updateLEDDisplay() {
   if (confirmationSwitchIndex >= 0) {
     confirmationLedIndex = ledMapping[confirmationSwitchIndex];
   }
+  // Kalibrier-Sweep der analogen Keys: alle LEDs gelb
+  if (analogKeyCalibrating) {
+    for (int i = 0; i < NUM_LEDS; i++) {
+      if (getLEDColorIdx(i) != COLOR_YELLOW_IDX) setLEDColor(i, COLOR_YELLOW_IDX, 120);
+    }
+    currentDisplayState = DISPLAY_IDLE;
+    return;
+  }
+  
   // ============================================
   // STATE 1: SUBMENU MODE
   // ============================================
@@ -117,9 +127,9 @@ void updateLEDDisplay() {
   // ============================================
   bool performanceActive = false;
   
-  // 1. Check currently sounding MIDI notes
-  for (int i = 0; i < 128; i++) {
-    if (IS_NOTE_ACTIVE(i)) {
+  // 1. Check currently sounding MIDI notes (alle Kanäle, byteweise)
+  for (int i = 0; i < 16; i++) {
+    if (activeMidiNotes[i]) {
       performanceActive = true;
       break;
     }
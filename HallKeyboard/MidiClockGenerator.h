@@ -3,19 +3,26 @@
  * 
  * Generiert MIDI Clock Output (24 PPQN):
  * - Synchronisiert mit ArduinoTapTempo BPM
- * - Sendet MIDI Clock Message (0xF8) via Serial1
+ * - Sendet MIDI Clock Message (0xF8) mit Vorrang via MidiUart (Realtime-Queue)
+ *   und parallel über USB-MIDI (UsbMidi.h)
  * 
  * INPUT:
  *   - tapTempo.getBPM()
+ *   - Bei externer Clock: geglättete Periode und nächster Puls der Clock-PLL (MidiClockReceiver.h)
  * 
  * OUTPUT:
- *   - MIDI Clock Messages (0xF8) via Serial1
+ *   - MIDI Clock Messages (0xF8) via MidiUart
+ *   - getClockPhase() - Position im 4-Beat Takt mit 3840 PPQN, zwischen den
+ *     24-PPQN Pulsen aus dem freilaufenden Timer0 (micros()) interpoliert,
+ *     bei jedem internen oder externen Puls neu verankert (Festkomma, kein float)
  */
 
 #ifndef MIDI_CLOCK_GENERATOR_H
 #define MIDI_CLOCK_GENERATOR_H
 
 #include "ArduinoTapTempo.h"
+#include "MidiUart.h"
+#include "UsbMidi.h"
 
 // ============================================
 // MIDI CLOCK STATE
@@ -27,6 +34,12 @@ volatile uint16_t ppqnCounter = 0;
 volatile uint16_t masterPulseCounter = 0; // 0-95 (für 4 Beats Synchronisation)
 volatile bool midiClockRunning = false;
 
+// Phasen-Akkumulator: 160 Sub-Ticks pro 24-PPQN Puls = 3840 PPQN (durch 2, 3, 4 und 5 teilbar)
+#define CLOCK_PHASE_PER_PULSE   160
+#define CLOCK_PHASE_PPQN        (CLOCK_PHASE_PER_PULSE * 24)
+#define CLOCK_PHASE_BAR         (CLOCK_PHASE_PPQN * 4)      // masterPulseCounter-Zyklus (96 Pulse)
+uint32_t clockPhaseRateQ16 = ((uint32_t)CLOCK_PHASE_PER_PULSE << 16) / 20833;   // Sub-Ticks pro µs * 65536
+
 // Konfiguration für Arpeggiator-Synchronisation
 bool stopClockOnArpDeactivate = true; // Ob MIDI STOP gesendet werden soll, wenn ARP stoppt
 
@@ -37,7 +50,9 @@ extern ArduinoTapTempo tapTempo;
 
 // Extern from MidiClockReceiver
 extern volatile bool midiClockActive;
-extern uint16_t calculatedBPM;
+extern uint32_t midiClockPeriodQ8;
+extern bool isMidiClockLocked();
+extern unsigned long getMidiClockNextPulseMicros();
 
 // ============================================
 // MIDI CLOCK CONSTANTS
@@ -59,7 +74,8 @@ extern uint16_t calculatedBPM;
  */
 ISR(TIMER1_COMPA_vect) {
   if (midiClockRunning && !midiClockActive) {
-    Serial1.write(MIDI_CLOCK);
+    midiUartWriteRealtime(MIDI_CLOCK);
+    usbMidiClockTick();
     ppqnCounter = (ppqnCounter + 1) % PPQN_VALUE;
     masterPulseCounter = (masterPulseCounter + 1) % 96; // 4 Beats a 24 PPQN
     lastClockMicros = micros();
@@ -90,19 +106,49 @@ void initMidiClockGenerator() {
   midiClockRunning = false;
 }
 
+/**
+ * Steigung des Phasen-Akkumulators aus dem aktuellen Pulsabstand (einmal pro Tempo-Änderung)
+ */
+void updateClockPhaseRate() {
+  if (clockIntervalMicros == 0) return;
+  clockPhaseRateQ16 = ((uint32_t)CLOCK_PHASE_PER_PULSE << 16) / clockIntervalMicros;
+}
+
+/**
+ * Aktuelle Phase im 4-Beat Takt (0 bis CLOCK_PHASE_BAR - 1):
+ * letzter Puls (masterPulseCounter, lastClockMicros) plus die seitdem vergangene
+ * Zeit, höchstens bis kurz vor den nächsten Puls (bleibt eine Clock aus, steht die Phase)
+ */
+uint32_t getClockPhase() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t pulse = masterPulseCounter;
+  unsigned long anchor = lastClockMicros;
+  SREG = sreg;
+
+  unsigned long elapsed = micros() - anchor;
+  if (elapsed > clockIntervalMicros) elapsed = clockIntervalMicros;
+  uint16_t sub = (elapsed * clockPhaseRateQ16) >> 16;
+  if (sub >= CLOCK_PHASE_PER_PULSE) sub = CLOCK_PHASE_PER_PULSE - 1;
+  return (uint32_t)pulse * CLOCK_PHASE_PER_PULSE + sub;
+}
+
 /**
  * Berechne Clock-Intervall basierend auf aktuellem BPM
  * Passt den Timer-Compare-Wert (OCR1A) an.
  */
 void updateClockInterval() {
-  float bpm;
-  
   if (midiClockActive) {
-    bpm = calculatedBPM;
-  } else {
-    bpm = tapTempo.getBPM();
+    // Externe Clock: Periode direkt aus der PLL (µs * 256, Timer-Tick = 4 µs)
+    cli();
+    OCR1A = midiClockPeriodQ8 >> 10;
+    sei();
+    clockIntervalMicros = midiClockPeriodQ8 >> 8;
+    updateClockPhaseRate();
+    return;
   }
   
+  float bpm = tapTempo.getBPM();
   if (bpm <= 0.0) bpm = 120.0;
   
   // Timer-Ticks berechnen (16MHz / 64 = 250kHz)
@@ -114,11 +160,12 @@ void updateClockInterval() {
   sei();
   
   clockIntervalMicros = (60000000.0 / bpm) / PPQN_VALUE;
+  updateClockPhaseRate();
 }
 
 /**
  * Setzt die Phase der internen Clock zurück.
- * Nützlich bei Empfang von externem MIDI Start.
+ * Nützlich beim Start der internen Clock (extern: setMidiClockPosition()).
  */
 void syncMidiClockPhase() {
   ppqnCounter = 0;
@@ -126,11 +173,26 @@ void syncMidiClockPhase() {
   lastClockMicros = micros();
 }
 
+/**
+ * Position für den externen Transport (Song Position Pointer, MIDI Start):
+ * der nächste externe Puls ist Puls 'pulses' ab Songanfang.
+ * handleExternalClockPulse() zählt vor der Auswertung weiter, daher ein Puls davor.
+ */
+void setMidiClockPosition(uint32_t pulses) {
+  uint8_t sreg = SREG;
+  cli();
+  ppqnCounter = (pulses + PPQN_VALUE - 1) % PPQN_VALUE;
+  masterPulseCounter = (pulses + 95) % 96;
+  lastClockMicros = micros();
+  SREG = sreg;
+}
+
 /**
  * Sende MIDI Clock Start Message
  */
 void startMidiClock() {
-  Serial1.write(MIDI_START);
+  midiUartWriteRealtime(MIDI_START);
+  usbMidiQueueRealtime(MIDI_START);
   syncMidiClockPhase();
   midiClockRunning = true;
 }
@@ -139,7 +201,8 @@ void startMidiClock() {
  * Sende MIDI Clock Stop Message
  */
 void stopMidiClock() {
-  Serial1.write(MIDI_STOP);
+  midiUartWriteRealtime(MIDI_STOP);
+  usbMidiQueueRealtime(MIDI_STOP);
   midiClockRunning = false;
 }
 
@@ -147,7 +210,8 @@ void stopMidiClock() {
  * Sende MIDI Clock Continue Message
  */
 void continueMidiClock() {
-  Serial1.write(MIDI_CONTINUE);
+  midiUartWriteRealtime(MIDI_CONTINUE);
+  usbMidiQueueRealtime(MIDI_CONTINUE);
   lastClockMicros = micros();
   midiClockRunning = true;
 }
@@ -155,16 +219,22 @@ void continueMidiClock() {
 /**
  * Verarbeitet einen externen MIDI Clock Pulse.
  * Synchronisiert die interne Phase mit der externen Quelle,
- * um Drift zu vermeiden.
+ * um Drift zu vermeiden. pulseMicros = Empfangszeitpunkt aus dem RX-ISR,
+ * pulses = 1 + von der PLL überbrückte ausgefallene Pulse.
  */
-void handleExternalClockPulse() {
-  ppqnCounter = (ppqnCounter + 1) % PPQN_VALUE;
-  masterPulseCounter = (masterPulseCounter + 1) % 96;
+void handleExternalClockPulse(unsigned long pulseMicros, uint8_t pulses) {
+  ppqnCounter = (ppqnCounter + pulses) % PPQN_VALUE;
+  masterPulseCounter = (masterPulseCounter + pulses) % 96;
   
-  // Setze den internen Timer zurück, damit der hausinterne Generator
-  // nicht im Konflikt mit dem externen Takt eigene Pulse sendet.
-  TCNT1 = 0; 
-  lastClockMicros = micros();
+  // Internen Timer auf den vorhergesagten nächsten externen Puls ausrichten:
+  // fällt die externe Clock weg, läuft der Generator phasengleich weiter
+  uint16_t ticksUntilNext = 0;
+  if (isMidiClockLocked()) {
+    unsigned long untilNext = getMidiClockNextPulseMicros() - micros();
+    if (untilNext < ((unsigned long)OCR1A << 2)) ticksUntilNext = untilNext >> 2;
+  }
+  TCNT1 = ticksUntilNext ? OCR1A - ticksUntilNext : 0;
+  lastClockMicros = pulseMicros;
 }
 
 /**
@@ -179,7 +249,8 @@ void syncMidiClockToBPM() {
   TCNT1 = 0;
   lastClockMicros = micros();
   // Optional: MIDI Start senden um Downbeat zu markieren
-  Serial1.write(MIDI_START);
+  midiUartWriteRealtime(MIDI_START);
+  usbMidiQueueRealtime(MIDI_START);
 }
 
 #endif
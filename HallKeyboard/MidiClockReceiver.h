@@ -3,93 +3,287 @@
  * 
  * Empfängt MIDI Clock Input (24 PPQN):
  * - Lightweight Implementation ohne MIDI Library
- * - Nur System Realtime Messages (0xF8-0xFF)
+ * - Alle Bytes laufen durch den MIDI Input Parser (MidiParser.h), die Clock
+ *   hängt sich an dessen Realtime-Handler, der Soft-Thru (MidiThru.h) an den
+ *   Message-Handler
+ * - Zeitstempel jedes Pulses aus dem RX-ISR (MidiUart.h), nicht vom Auslesen in loop()
+ * - Alpha-Beta-Filter (Software-PLL) auf Pulsabstand und Phase in Festkomma
+ *   (µs * 256): geglättete Periode, vorhergesagter nächster Puls, Ausreißer
+ *   werden verworfen, ausgefallene Pulse überbrückt
  * - Synchronisiert HallKeyboard mit externem MIDI Clock
+ * - Transport: Start ab Songanfang, Song Position Pointer setzt Takt-Phase und
+ *   Arp-Step, Continue läuft ab der gespeicherten Position weiter, Stop hält den
+ *   Arp sofort an (Pulse im Stop rücken die Phase nicht weiter)
  * - Auto-Detection via Timeout
  * - Fallback zu TapTempo bei Clock Timeout
  * 
  * INPUT:
- *   - MIDI Clock Messages (0xF8) via Serial1
- *   - MIDI Start/Stop/Continue (0xFA/0xFC/0xFB)
+ *   - MIDI Clock Messages (0xF8) via MidiUart (RX Ring-Buffer)
+ *   - MIDI Start/Stop/Continue (0xFA/0xFC/0xFB), Song Position Pointer (0xF2)
  * 
  * OUTPUT:
  *   - midiClockActive (bool)
- *   - calculatedBPM (uint16_t)
+ *   - midiClockStopped (bool) - Transport per MIDI Stop angehalten
+ *   - midiClockPeriodQ8 / midiClockBpmX100 - geglättete Periode (µs * 256) und BPM * 100
+ *   - getMidiClockNextPulseMicros() - vorhergesagter nächster Puls
+ *   - calculatedBPM (uint16_t, gerundet aus midiClockBpmX100)
+ *   - midiClockRxStats - Jitter der Pulsabstände (ISR- vs. loop()-Zeitstempel)
  */
 
 #ifndef MIDI_CLOCK_RECEIVER_H
 #define MIDI_CLOCK_RECEIVER_H
 
 #include "ArduinoTapTempo.h"
+#include "MidiUart.h"
+#include "MidiParser.h"
 
 // ============================================
 // EXTERNAL VARIABLES & FUNCTIONS
 // ============================================
 extern ArduinoTapTempo tapTempo;
-extern void syncMidiClockPhase();
-extern void handleExternalClockPulse();
+extern void setMidiClockPosition(uint32_t pulses);
+extern void handleExternalClockPulse(unsigned long pulseMicros, uint8_t pulses);
 extern void resetArpeggiatorPhase();
+extern void syncArpeggiatorToSongPosition(uint32_t pulses);
+extern void stopArpeggiatorNote();
 
 // ============================================
 // MIDI CLOCK RECEIVER STATE
 // ============================================
 
 volatile bool midiClockActive = false;
+bool midiClockStopped = false;   // Nach 0xFC bis Start/Continue oder Clock-Timeout
 unsigned long lastMidiClockMicros = 0;
 uint16_t calculatedBPM = 120; // uint16_t statt float spart 2 bytes
 
 // Timeout Configuration
 #define MIDI_CLOCK_TIMEOUT_MICROS 500000UL  // erhöht auf 500ms für mehr Stabilität (ca. 12 Pulses bei 30 BPM)
 
-// MIDI System Realtime Messages (1 byte, kein Status-Byte-Logik nötig)
-#define MIDI_CLOCK_MSG      0xF8
-#define MIDI_START_MSG      0xFA
-#define MIDI_CONTINUE_MSG   0xFB
-#define MIDI_STOP_MSG       0xFC
+// Clock-Eingang: Änderung des Pulsabstands von Puls zu Puls, einmal mit dem
+// Zeitstempel aus dem RX-ISR, einmal mit micros() beim Auslesen in loop() (Vergleich)
+struct MidiClockRxStats {
+  uint16_t count;
+  uint16_t maxJitter;         // µs, ISR-Zeitstempel
+  uint32_t sumJitter;         // µs, Mittelwert = sumJitter / count
+  uint16_t maxLoopJitter;     // µs, loop()-Zeitstempel
+  uint32_t sumLoopJitter;     // µs
+  uint16_t maxLatency;        // µs, Empfang im ISR -> Auswertung in loop()
+};
+MidiClockRxStats midiClockRxStats;
+
+// Clock-PLL: Festkomma µs * 256 (1/256 µs pro Puls = < 0.001 BPM bei 300 BPM)
+#define MIDI_PLL_PERIOD_MIN_Q8   (8333UL << 8)     // 300 BPM
+#define MIDI_PLL_PERIOD_MAX_Q8   (83333UL << 8)    // 30 BPM
+#define MIDI_PLL_ALPHA_SHIFT     2     // Phase: 1/4 des Fehlers
+#define MIDI_PLL_BETA_SHIFT      5     // Periode: 1/32 des Fehlers (kritisch gedämpft)
+#define MIDI_PLL_FAST_PULSES     24    // Erster Beat nach dem Einrasten: doppelte Gains
+#define MIDI_PLL_MAX_OUTLIERS    4     // So viele Ausreißer in Folge -> neu einrasten
+#define MIDI_PLL_DUPLICATE       (-1)  // Rückgabe von updateMidiClockPll(): Puls nicht zählen
+
+#define MIDI_PLL_IDLE     0    // Noch kein Puls
+#define MIDI_PLL_ACQUIRE  1    // Ein Puls, Periode noch unbekannt
+#define MIDI_PLL_LOCKED   2
+
+uint8_t midiClockPllState = MIDI_PLL_IDLE;
+uint32_t midiClockPeriodQ8 = 20833UL << 8;       // Geglätteter Pulsabstand (Default 120 BPM)
+uint32_t midiClockPredictedQ8 = 0;               // Vorhergesagter nächster Puls (µs * 256, läuft über)
+uint16_t midiClockBpmX100 = 12000;
+uint8_t midiClockPllFastPulses = 0;
+uint8_t midiClockPllOutliers = 0;                // Ausreißer in Folge
+unsigned long midiClockLastPulseMicros = 0;
+
+struct MidiClockPllStats {
+  uint16_t outliers;          // Verworfene Pulse
+  uint16_t missedPulses;      // Überbrückte, ausgefallene Pulse
+  uint16_t relocks;
+};
+MidiClockPllStats midiClockPllStats;
 
 // ============================================
-// LIGHTWEIGHT MIDI CLOCK HANDLERS
+// MIDI CLOCK RX STATISTICS
 // ============================================
 
 /**
- * Handler für MIDI Clock Pulse (0xF8)
+ * Jitter-Statistik für einen Puls (rxMicros aus dem ISR, loopMicros beim Auslesen)
  */
-inline void processMidiClock() {
-  unsigned long currentMicros = micros();
-  
-  // BPM Berechnung nur alle 24 Pulses (einmal pro Beat)
-  // Optimiert: Verwendet statische lokale Variable statt globaler
-  static unsigned long lastBeatMicros = 0;
-  static uint8_t pulseCount = 0;
-  static bool firstBPMCalculation = true;
-  
-  pulseCount++;
-  if (pulseCount >= 24) {
-    pulseCount = 0;
-    
-    if (lastBeatMicros > 0) {
-      unsigned long beatInterval = currentMicros - lastBeatMicros;
-      
-      // BPM = 60.000.000 µs / beatInterval
-      // Vereinfachte Integer-Berechnung spart RAM
-      if (beatInterval > 0) {
-        uint16_t newBPM = 60000000UL / beatInterval;
-        
-        // Sanity Check: BPM Limits (30-300 BPM)
-        if (newBPM >= 30 && newBPM <= 300) {
-          calculatedBPM = newBPM;
-        }
+void recordMidiClockRx(unsigned long rxMicros, unsigned long loopMicros) {
+  static unsigned long lastRxMicros = 0;
+  static unsigned long lastLoopMicros = 0;
+  static unsigned long lastRxInterval = 0;
+  static unsigned long lastLoopInterval = 0;
+
+  unsigned long rxInterval = rxMicros - lastRxMicros;
+  unsigned long loopInterval = loopMicros - lastLoopMicros;
+  bool valid = lastRxInterval != 0 && rxInterval < MIDI_CLOCK_TIMEOUT_MICROS && lastRxInterval < MIDI_CLOCK_TIMEOUT_MICROS;
+  if (valid && midiClockRxStats.count < 0xFFFF) {
+    unsigned long jitter = (rxInterval > lastRxInterval) ? rxInterval - lastRxInterval : lastRxInterval - rxInterval;
+    unsigned long loopJitter = (loopInterval > lastLoopInterval) ? loopInterval - lastLoopInterval : lastLoopInterval - loopInterval;
+    unsigned long latency = loopMicros - rxMicros;
+    if (jitter > 0xFFFF) jitter = 0xFFFF;
+    if (loopJitter > 0xFFFF) loopJitter = 0xFFFF;
+    if (latency > 0xFFFF) latency = 0xFFFF;
+    if (jitter > midiClockRxStats.maxJitter) midiClockRxStats.maxJitter = jitter;
+    if (loopJitter > midiClockRxStats.maxLoopJitter) midiClockRxStats.maxLoopJitter = loopJitter;
+    if (latency > midiClockRxStats.maxLatency) midiClockRxStats.maxLatency = latency;
+    midiClockRxStats.sumJitter += jitter;
+    midiClockRxStats.sumLoopJitter += loopJitter;
+    midiClockRxStats.count++;
+  }
+  lastRxMicros = rxMicros;
+  lastLoopMicros = loopMicros;
+  lastRxInterval = rxInterval;
+  lastLoopInterval = loopInterval;
+}
+
+void resetMidiClockRxStats() {
+  midiClockRxStats.count = 0;
+  midiClockRxStats.maxJitter = 0;
+  midiClockRxStats.sumJitter = 0;
+  midiClockRxStats.maxLoopJitter = 0;
+  midiClockRxStats.sumLoopJitter = 0;
+  midiClockRxStats.maxLatency = 0;
+}
+
+// ============================================
+// MIDI CLOCK PLL
+// ============================================
+
+/**
+ * BPM * 100 aus der geglätteten Periode: 60e6 * 100 / 24 / (Periode in µs)
+ * = 4e9 / (Periode in 1/16 µs), passt in 32 Bit
+ */
+void updateMidiClockBpm() {
+  midiClockBpmX100 = 4000000000UL / (midiClockPeriodQ8 >> 4);
+  calculatedBPM = (midiClockBpmX100 + 50) / 100;
+}
+
+inline uint32_t clampMidiClockPeriod(uint32_t periodQ8) {
+  if (periodQ8 < MIDI_PLL_PERIOD_MIN_Q8) return MIDI_PLL_PERIOD_MIN_Q8;
+  if (periodQ8 > MIDI_PLL_PERIOD_MAX_Q8) return MIDI_PLL_PERIOD_MAX_Q8;
+  return periodQ8;
+}
+
+void resetMidiClockPll() {
+  midiClockPllState = MIDI_PLL_IDLE;
+  midiClockPllOutliers = 0;
+}
+
+/**
+ * Ein Puls (Zeitstempel aus dem RX-ISR) in die PLL:
+ * Fehler e = Puls - Vorhersage, Phase += e/4, Periode += e/32, Vorhersage += Periode
+ * Rückgabe: Anzahl davor ausgefallener (überbrückter) Pulse,
+ * MIDI_PLL_DUPLICATE für einen zu frühen/doppelten Puls, der nicht mitzählt
+ */
+int8_t updateMidiClockPll(unsigned long pulseMicros) {
+  uint32_t pulseQ8 = (uint32_t)pulseMicros << 8;   // Überlauf egal, es zählen nur Differenzen
+
+  if (midiClockPllState == MIDI_PLL_IDLE) {
+    midiClockPllState = MIDI_PLL_ACQUIRE;
+  } else if (midiClockPllState == MIDI_PLL_ACQUIRE) {
+    unsigned long interval = pulseMicros - midiClockLastPulseMicros;
+    if (interval < MIDI_CLOCK_TIMEOUT_MICROS) {
+      midiClockPeriodQ8 = clampMidiClockPeriod((uint32_t)interval << 8);
+      midiClockPredictedQ8 = pulseQ8 + midiClockPeriodQ8;
+      midiClockPllState = MIDI_PLL_LOCKED;
+      midiClockPllFastPulses = MIDI_PLL_FAST_PULSES;
+      midiClockPllOutliers = 0;
+      updateMidiClockBpm();
+    }
+  } else {
+    int32_t error = (int32_t)(pulseQ8 - midiClockPredictedQ8);
+    int32_t period = (int32_t)midiClockPeriodQ8;
+
+    // Ausgefallene Pulse (z.B. RX-Überlauf): Vorhersage um ganze Perioden weiterschieben
+    uint8_t missed = 0;
+    while (error > period / 2 && missed < MIDI_PLL_MAX_OUTLIERS) {
+      midiClockPredictedQ8 += midiClockPeriodQ8;
+      error -= period;
+      missed++;
+    }
+
+    // Ausreißer (doppelter/verrutschter Puls) nicht in den Filter, nach mehreren in Folge neu einrasten
+    if (error > period / 4 || error < -period / 4) {
+      midiClockPllStats.outliers++;
+      midiClockLastPulseMicros = pulseMicros;
+      if (++midiClockPllOutliers >= MIDI_PLL_MAX_OUTLIERS) {
+        midiClockPllStats.relocks++;
+        midiClockPllState = MIDI_PLL_ACQUIRE;
+        return 0;
+      }
+      if (error > 0) {
+        // Verspäteter echter Puls: belegt seinen Platz, sonst käme der nächste
+        // eine Periode nach der alten Vorhersage und würde doppelt gezählt
+        midiClockPredictedQ8 += midiClockPeriodQ8;
+        midiClockPllStats.missedPulses += missed;
+        return missed;
       }
+      // Zu früh oder doppelt: Vorhersage unverändert lassen, Puls nicht zählen
+      midiClockPredictedQ8 -= (uint32_t)missed * midiClockPeriodQ8;
+      return MIDI_PLL_DUPLICATE;
     }
-    
-    lastBeatMicros = currentMicros;
+    midiClockPllStats.missedPulses += missed;
+    midiClockPllOutliers = 0;
+
+    uint8_t fast = (midiClockPllFastPulses > 0) ? 1 : 0;
+    if (fast) midiClockPllFastPulses--;
+    midiClockPredictedQ8 += error / (1L << (MIDI_PLL_ALPHA_SHIFT - fast));
+    midiClockPeriodQ8 = clampMidiClockPeriod(midiClockPeriodQ8 + error / (1L << (MIDI_PLL_BETA_SHIFT - fast)));
+    midiClockPredictedQ8 += midiClockPeriodQ8;
+    updateMidiClockBpm();
+    midiClockLastPulseMicros = pulseMicros;
+    return missed;
   }
+  midiClockLastPulseMicros = pulseMicros;
+  return 0;
+}
+
+/**
+ * Vorhergesagter Zeitpunkt (micros()) des nächsten externen Pulses
+ */
+inline unsigned long getMidiClockNextPulseMicros() {
+  // Vorhersage ist nur in den unteren 24 Bit von micros() gespeichert: relativ zum letzten Puls
+  int32_t aheadQ8 = (int32_t)(midiClockPredictedQ8 - ((uint32_t)midiClockLastPulseMicros << 8));
+  return midiClockLastPulseMicros + aheadQ8 / 256;
+}
+
+/**
+ * PLL eingerastet (Periode und Vorhersage gültig)
+ */
+inline bool isMidiClockLocked() {
+  return midiClockPllState == MIDI_PLL_LOCKED;
+}
+
+/**
+ * Geglätteter Pulsabstand in µs
+ */
+inline unsigned long getMidiClockPeriodMicros() {
+  return midiClockPeriodQ8 >> 8;
+}
+
+// ============================================
+// LIGHTWEIGHT MIDI CLOCK HANDLERS
+// ============================================
+
+/**
+ * Handler für MIDI Clock Pulse (0xF8)
+ */
+inline void processMidiClock() {
+  // Empfangszeitpunkt aus dem RX-ISR statt micros() beim Auslesen (loop()-Latenz)
+  unsigned long currentMicros = midiUartReadClockMicros();
+  recordMidiClockRx(currentMicros, micros());
+  int8_t missed = updateMidiClockPll(currentMicros);
   
+  // Erste Clock nach einem Timeout ohne Start (Quelle ohne Transport): nicht angehalten
+  if (!midiClockActive) midiClockStopped = false;
   lastMidiClockMicros = currentMicros;
   midiClockActive = true;
   
   // Update globale Taktphase direkt über den Pulse (verhindert Drift)
-  handleExternalClockPulse();
+  // Im Stop laufen die Pulse weiter (Tempo), die Song-Position aber nicht.
+  // Ausgefallene Pulse (z.B. verworfenes 0xF8 bei vollem Zeitstempel-Puffer) zählen
+  // mit, sonst verschiebt jeder einzelne das Arp-Raster und die SPP-Position dauerhaft
+  // Ein doppelter/zu früher Puls zählt gar nicht
+  if (!midiClockStopped && missed != MIDI_PLL_DUPLICATE) handleExternalClockPulse(currentMicros, missed + 1);
 }
 
 /**
@@ -98,27 +292,38 @@ inline void processMidiClock() {
 inline void processMidiStart() {
   lastMidiClockMicros = micros();
   midiClockActive = true;
-  syncMidiClockPhase();
+  midiClockStopped = false;
+  setMidiClockPosition(0);   // Der erste Puls nach Start ist der Downbeat
   resetArpeggiatorPhase();
   tapTempo.resetTapChain(); // Interne Phase des TapTempos (für LEDs etc.) resetten
 }
 
 /**
  * Handler für MIDI Continue (0xFB)
+ * Weiter ab der gespeicherten Position (Stand beim Stop oder letzter Song Position Pointer)
  */
 inline void processMidiContinue() {
   lastMidiClockMicros = micros();
   midiClockActive = true;
-  syncMidiClockPhase();
-  resetArpeggiatorPhase();
-  tapTempo.resetTapChain();
+  midiClockStopped = false;
 }
 
 /**
  * Handler für MIDI Stop (0xFC)
+ * Arp sofort anhalten; die Clock selbst wird weiterhin nur per Timeout deaktiviert
  */
 inline void processMidiStop() {
-  // Clock wird nur per Timeout deaktiviert
+  midiClockStopped = true;
+  stopArpeggiatorNote();
+}
+
+/**
+ * Handler für Song Position Pointer (0xF2), Position in 16teln (6 Pulse)
+ */
+inline void processMidiSongPosition(uint16_t beats) {
+  uint32_t pulses = (uint32_t)beats * 6;
+  setMidiClockPosition(pulses);
+  syncArpeggiatorToSongPosition(pulses);
 }
 
 // ============================================
@@ -130,43 +335,38 @@ inline void processMidiStop() {
  */
 void initMidiClockReceiver() {
   midiClockActive = false;
+  midiClockStopped = false;
   lastMidiClockMicros = 0;
   calculatedBPM = 120;
-  // Serial1 wird bereits in setup() initialisiert (31250 Baud)
+  resetMidiClockPll();
+  initMidiParser();
+  midiInputHandlers.clock = processMidiClock;
+  midiInputHandlers.start = processMidiStart;
+  midiInputHandlers.cont = processMidiContinue;
+  midiInputHandlers.stop = processMidiStop;
+  midiInputHandlers.songPosition = processMidiSongPosition;
+  // USART1 wird bereits in setup() initialisiert (initMidiUart, 31250 Baud)
 }
 
 /**
  * Update-Funktion - rufe in loop() auf
- * Liest MIDI Input von Serial1 und prüft Timeout
+ * Liest MIDI Input aus dem RX-Puffer und prüft Timeout
  */
 void updateMidiClockReceiver() {
-  // Poll Serial1 für MIDI Messages
-  while (Serial1.available()) {
-    uint8_t midiByte = Serial1.read();
-    
-    // System Realtime Messages (0xF8-0xFF) haben höchste Priorität
-    // und können jederzeit auftreten (auch mitten in anderen Messages)
-    switch (midiByte) {
-      case MIDI_CLOCK_MSG:
-        processMidiClock();
-        break;
-      case MIDI_START_MSG:
-        processMidiStart();
-        break;
-      case MIDI_CONTINUE_MSG:
-        processMidiContinue();
-        break;
-      case MIDI_STOP_MSG:
-        processMidiStop();
-        break;
-      // Alle anderen Messages ignorieren (für Clock irrelevant)
-    }
+  // Poll RX-Puffer, der Parser verteilt an Clock-Handler und Soft-Thru
+  // (Realtime-Bytes dürfen jederzeit kommen, auch mitten in anderen Messages)
+  while (midiUartAvailable()) {
+    midiParserInput(midiUartRead());
   }
   
   // Timeout Detection
   if (midiClockActive) {
     if ((micros() - lastMidiClockMicros) > MIDI_CLOCK_TIMEOUT_MICROS) {
       midiClockActive = false;
+      // Viele DAWs senden nach Stop keine Clock mehr: der Arp läuft dann wie
+      // vorher auf der internen Clock weiter statt bis zum Umschalten stumm zu bleiben
+      midiClockStopped = false;
+      resetMidiClockPll();
     }
   }
 }
@@ -0,0 +1,140 @@
+/**
+ * MIDI EVENT BUS
+ *
+ * Gemeinsamer Weg aller Noten-Events von Software Controller, Chord Mode und
+ * Arpeggiator zum MIDI Generator:
+ * - MidiEvent: 4 Byte, wird per Wert übergeben (statt drei int pro Aufruf)
+ * - Layer posten nur Events mit ihrem Layer, Kanal-Routing, Voice-Zählung,
+ *   Dedupe und Batching passieren an einer Stelle (processMidiEvents())
+ * - Feste Queue (Zweierpotenz), kein malloc; ist sie voll, wird sofort verarbeitet
+ *
+ * INPUT:
+ *   - postMidiEvent() aus den Layern
+ * OUTPUT:
+ *   - midiEventQueue[] - wird vom MIDI Generator einmal pro loop() geleert
+ */
+
+#ifndef MIDI_EVENT_BUS_H
+#define MIDI_EVENT_BUS_H
+
+#include "arduino_stubs.h"
+#include "MidiRouting.h"
+
+// ============================================
+// MIDI EVENT TYPES
+// ============================================
+
+#define MIDI_EVENT_NOTE_ON       0x10   // Stimme belegen (Note On beim ersten Besitzer)
+#define MIDI_EVENT_NOTE_OFF      0x20   // Einen Besitzer freigeben
+#define MIDI_EVENT_NOTE_OFF_ALL  0x30   // Alle Tasten-Besitzer einer Tonhöhe freigeben
+
+#define MIDI_CHANNEL_ROUTED      0xFF   // Kanal aus dem Layer-Routing
+
+#define MIDI_EVENT_QUEUE_SIZE    16     // Muss eine Zweierpotenz sein
+
+struct MidiEvent {
+  uint8_t type;       // MIDI_EVENT_* im oberen Nibble, MIDI_LAYER_* im unteren
+  uint8_t pitch;
+  uint8_t velocity;
+  uint8_t channel;    // 0-15 oder MIDI_CHANNEL_ROUTED
+};
+
+#define MIDI_EVENT_KIND(e)  ((e).type & 0xF0)
+#define MIDI_EVENT_LAYER(e) ((e).type & 0x0F)
+
+// ============================================
+// MIDI EVENT BUS STATE
+// ============================================
+
+MidiEvent midiEventQueue[MIDI_EVENT_QUEUE_SIZE];
+uint8_t midiEventHead = 0;
+uint8_t midiEventTail = 0;
+unsigned long midiEventMicros = 0;   // Frühester Tasten-Zeitstempel der wartenden Events
+
+extern unsigned long noteEventMicros;
+extern void processMidiEvents();
+
+// ============================================
+// MIDI EVENT CONSTRUCTORS
+// ============================================
+
+inline MidiEvent makeMidiEvent(uint8_t kind, uint8_t layer, int pitch, uint8_t velocity) {
+  MidiEvent e;
+  e.type = kind | layer;
+  e.pitch = (pitch >= 0 && pitch < 128) ? pitch : 0xFF;   // Ungültig: wird beim Posten verworfen
+  e.velocity = velocity;
+  e.channel = MIDI_CHANNEL_ROUTED;
+  return e;
+}
+
+inline MidiEvent midiNoteOnEvent(uint8_t layer, int pitch, uint8_t velocity) {
+  return makeMidiEvent(MIDI_EVENT_NOTE_ON, layer, pitch, velocity);
+}
+
+inline MidiEvent midiNoteOffEvent(uint8_t layer, int pitch) {
+  return makeMidiEvent(MIDI_EVENT_NOTE_OFF, layer, pitch, 0);
+}
+
+// Note Off auf einem festen Kanal (der beim Note On gemerkt wurde), unabhängig vom aktuellen Routing
+inline MidiEvent midiNoteOffEventOnChannel(uint8_t layer, int pitch, uint8_t channel) {
+  MidiEvent e = makeMidiEvent(MIDI_EVENT_NOTE_OFF, layer, pitch, 0);
+  e.channel = channel;
+  return e;
+}
+
+// Layer und Kanal einer eingeschalteten Note in einem Byte (Layer oben, Kanal unten),
+// damit das Note Off denselben Layer trägt und auf demselben Kanal landet
+#define MIDI_NOTE_ROUTE(layer) ((uint8_t)(((layer) << 4) | midiLayerChannel[layer]))
+
+inline MidiEvent midiNoteOffEventForRoute(uint8_t route, int pitch) {
+  return midiNoteOffEventOnChannel(route >> 4, pitch, route & 0x0F);
+}
+
+inline MidiEvent midiNoteOffAllEvent(uint8_t layer, int pitch) {
+  return makeMidiEvent(MIDI_EVENT_NOTE_OFF_ALL, layer, pitch, 0);
+}
+
+// ============================================
+// MIDI EVENT BUS FUNCTIONS
+// ============================================
+
+/**
+ * Event in die Queue (Reihenfolge bleibt erhalten)
+ */
+void postMidiEvent(MidiEvent e) {
+  if (e.pitch >= 128) return;
+  uint8_t next = (midiEventHead + 1) & (MIDI_EVENT_QUEUE_SIZE - 1);
+  if (next == midiEventTail) {
+    processMidiEvents();   // Voll: vorzeitig verarbeiten
+  }
+  midiEventQueue[midiEventHead] = e;
+  midiEventHead = next;
+  if (noteEventMicros != 0 && midiEventMicros == 0) midiEventMicros = noteEventMicros;
+}
+
+inline bool peekMidiEvent(MidiEvent &e) {
+  if (midiEventTail == midiEventHead) return false;
+  e = midiEventQueue[midiEventTail];
+  return true;
+}
+
+inline void dropMidiEvent() {
+  midiEventTail = (midiEventTail + 1) & (MIDI_EVENT_QUEUE_SIZE - 1);
+}
+
+inline void clearMidiEvents() {
+  midiEventTail = midiEventHead;
+  midiEventMicros = 0;
+}
+
+/**
+ * Wartet für diese Tonhöhe noch ein Note On in der Queue?
+ */
+bool isMidiNoteOnPending(uint8_t pitch) {
+  for (uint8_t i = midiEventTail; i != midiEventHead; i = (i + 1) & (MIDI_EVENT_QUEUE_SIZE - 1)) {
+    if (midiEventQueue[i].pitch == pitch && MIDI_EVENT_KIND(midiEventQueue[i]) == MIDI_EVENT_NOTE_ON) return true;
+  }
+  return false;
+}
+
+#endif
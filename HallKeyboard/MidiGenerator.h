@@ -4,15 +4,26 @@
  * Isolierte Logik für MIDI-Ausgabe:
  * - Nimmt Noten-Arrays von Hold Mode, Chord Mode, Arpeggiator
  * - Generiert MIDI Note On/Off Signale
- * - Verwaltet activeMidiNotes[] für LED-Anzeige
+ * - Output-Encoder: Running Status + einheitliche Note-Off Kodierung
+ * - Transaktions-Puffer pro loop(): Note Events werden gesammelt, gegenläufige
+ *   On/Off derselben Note fallen weg, Offs gehen vor Ons in einem Burst raus
+ * - Asynchrone Panic: CC123/CC120 pro benutztem Kanal + Note Offs nur für
+ *   getrackte Noten, verteilt über mehrere loop()-Durchläufe (blockiert nie)
+ * - Bandbreiten-Messung (Bytes/s, Füllstand TX-Puffer) mit Traffic Shaping bei
+ *   nahezu voller DIN-Leitung: CCs zusammenfassen, veralteten Aftertouch verwerfen,
+ *   Clock und Note Offs werden nie verzögert
+ * - Aktive Noten pro MIDI-Kanal als 16-Byte Bitset, nur für benutzte Kanäle
+ *   (Layer-Routing siehe MidiRouting.h), activeMidiNotes[] als Vereinigung für LEDs
+ * - Voice Allocator: Note On nur bei 0->1, Note Off nur bei 1->0 Besitzern
+ * - Alle Layer posten MidiEvents auf den Event Bus (MidiEventBus.h), Kanal-Routing
+ *   und Voice-Zählung passieren nur hier in processMidiEvents()
  * 
  * INPUT:
- *   - holdModeMidiNotes[] vom Hold Mode Layer
- *   - chordModeMidiNotes[] vom Chord Mode Layer
- *   - arpeggiatorMidiNotes[] vom Arpeggiator Mode Layer
+ *   - midiEventQueue[] von Software Controller, Chord Mode und Arpeggiator
  * 
  * OUTPUT:
- *   - MIDI Signale via Serial1
+ *   - MIDI Signale via MidiUart (Channel-Message Ring-Buffer)
+ *   - Dieselben Messages als USB-MIDI Pakete (UsbMidi.h)
  *   - activeMidiNotes[] für LED Controller
  */
 
@@ -20,17 +31,146 @@
 #define MIDI_GENERATOR_H
 
 #include "HardwareController.h"
+#include "MidiUart.h"
+#include "UsbMidi.h"
+#include "MidiRouting.h"
+#include "MidiEventBus.h"
 
 // ============================================
 // MIDI GENERATOR STATE
 // ============================================
 
-// Tracke alle aktiven MIDI-Noten (von allen Modi kombiniert)
-// Eingespart: Bitset statt bool[128]
+// Note Off Kodierung: 1 = immer 0x9n/Velocity 0 (nutzt Running Status),
+// 0 = immer 0x8n/Velocity 0 (für Geräte, die echte Note Offs erwarten)
+#ifndef MIDI_NOTE_OFF_AS_NOTE_ON
+#define MIDI_NOTE_OFF_AS_NOTE_ON 1
+#endif
+
+// Status-Byte spätestens nach dieser Zeit erneut senden (Empfänger, die später
+// angesteckt werden, fangen sich so wieder)
+#define MIDI_RUNNING_STATUS_REFRESH_MS 1000
+
+uint8_t midiRunningStatus = 0;        // 0 = kein gültiger Running Status
+unsigned long midiRunningStatusTime = 0;
+
+// Aftertouch Budget: Anteil der DIN-Bandbreite (31250 Baud = 3125 Bytes/s),
+// damit Note On/Off und Clock-Bytes nicht hinter Aftertouch-Bursts warten
+#define MIDI_DIN_BYTES_PER_SEC          3125
+#define MIDI_AFTERTOUCH_BUDGET_PERCENT  30
+#define MIDI_AFTERTOUCH_BURST_BYTES     12    // Max. angesparter Burst
+#define MIDI_AFTERTOUCH_MIN_TX_FREE     16    // Freier Platz im TX-Puffer für Noten/Clock
+
+// Budget in 1/100 Byte (Nachfüllen pro ms ohne Float)
+#define MIDI_AFTERTOUCH_CREDIT_PER_MS   (MIDI_DIN_BYTES_PER_SEC * MIDI_AFTERTOUCH_BUDGET_PERCENT / 1000)
+#define MIDI_AFTERTOUCH_CREDIT_MAX      (MIDI_AFTERTOUCH_BURST_BYTES * 100)
+#define MIDI_AFTERTOUCH_MESSAGE_COST    300
+
+// Bandbreiten-Messung und Traffic Shaping (updateMidiBandwidthMeter)
+#define MIDI_METER_WINDOW_MS        100   // Messfenster für Bytes/s
+#define MIDI_SHAPER_LOAD_ON         80    // % der DIN-Bandbreite: Shaping an
+#define MIDI_SHAPER_LOAD_OFF        60    // % der DIN-Bandbreite: Shaping aus (Hysterese)
+#define MIDI_SHAPER_QUEUE_ON        (MIDI_TX_BUFFER_SIZE / 2)   // Bytes im TX-Puffer: sofort an
+#define MIDI_SHAPER_CC_INTERVAL_MS  10    // Zusammengefasste CCs beim Shaping höchstens so oft
+#define MIDI_CC_COALESCE_SLOTS      8
+
+struct MidiBandwidthStats {
+  uint16_t bytesPerSec;           // Letztes Messfenster
+  uint16_t peakBytesPerSec;
+  uint8_t queueDepth;             // Bytes im TX-Puffer beim letzten Update
+  uint8_t peakQueueDepth;
+  uint16_t droppedAftertouch;     // Beim Shaping verworfene Aftertouch-Updates
+  uint16_t coalescedControllers;  // Durch neuere Werte ersetzte CCs
+};
+MidiBandwidthStats midiBandwidthStats;
+bool midiShapingActive = false;
+unsigned long midiMeterWindowStart = 0;
+uint16_t midiMeterWindowBytes = 0;      // Byte-Zähler beim Fensterstart
+
+// CC Zusammenfassung: pro Kanal/Controller zählt nur der letzte Wert
+struct PendingController {
+  uint8_t status;       // 0xBn, 0 = frei
+  uint8_t controller;
+  uint8_t value;
+};
+PendingController pendingControllers[MIDI_CC_COALESCE_SLOTS];
+unsigned long pendingControllersTime = 0;
+
+// Transaktions-Puffer: Note Events eines loop()-Durchlaufs (flushMidiTransaction)
+#define MIDI_TX_MAX_STAGED 16
+
+// Off + On derselben klingenden Note im selben Frame: 1 = Note klingt einfach weiter
+// (gemeinsame Töne beim Akkordwechsel), 0 = Retrigger (Off, dann On)
+#ifndef MIDI_TX_TIE_COMMON_NOTES
+#define MIDI_TX_TIE_COMMON_NOTES 1
+#endif
+
+#define STAGED_WAS_ACTIVE 0x01   // Note klang vor diesem Frame
+#define STAGED_SAW_OFF    0x02   // In diesem Frame wurde ein Off gestaged
+
+struct StagedNote {
+  uint8_t pitch;
+  uint8_t velocity;   // Endzustand im Frame: 0 = Off
+  uint8_t flags;      // STAGED_* Bits, Kanal im oberen Nibble
+};
+StagedNote stagedNotes[MIDI_TX_MAX_STAGED];
+uint8_t numStagedNotes = 0;
+unsigned long stagedEventMicros = 0;   // Frühester Tasten-Zeitstempel im Frame
+
+// Panic Engine (killAllMidiNotes / updateMidiPanic)
+#define PANIC_IDLE         0
+#define PANIC_CONTROLLERS  1   // CC123 All Notes Off + CC120 All Sound Off pro Kanal
+#define PANIC_NOTES        2   // Note Offs für die beim Start aktiven Noten
+
+uint16_t midiChannelsInUse = 0x0001;   // Bit n = MIDI Kanal n+1 wird von uns benutzt
+uint8_t midiPanicState = PANIC_IDLE;
+uint8_t midiPanicChannel = 0;
+uint8_t midiPanicNote = 0;
+uint8_t midiPanicNotes[16];            // Snapshot von activeMidiNotes beim Panic-Start
+uint16_t midiPanicNoteChannels = 0;    // Kanäle, die beim Panic-Start Noten hatten
+
+#define IS_PANIC_NOTE(n) ((midiPanicNotes[(n) >> 3] >> ((n) & 7)) & 1)
+#define CLEAR_PANIC_NOTE(n) midiPanicNotes[(n) >> 3] &= ~(1 << ((n) & 7))
+
+// Latenz Tasten-Event (Scanner-Zeitstempel) -> MIDI-Byte im Sendepuffer
+struct NoteLatencyStats {
+  uint16_t count;
+  uint16_t last;      // µs
+  uint16_t max;       // µs
+  uint32_t sum;       // µs, für Mittelwert = sum / count
+};
+NoteLatencyStats noteLatencyStats;
+
+uint16_t midiAftertouchCredit = MIDI_AFTERTOUCH_CREDIT_MAX;
+unsigned long midiAftertouchRefillTime = 0;
+
+// Aktive Noten pro Kanal: ein 16-Byte Bitset pro Slot, Slots werden nur an
+// Kanäle vergeben, auf denen gerade Noten klingen (statt 16 x 16 Bytes fest)
+#define MIDI_MAX_CHANNEL_SLOTS 4
+#define MIDI_SLOT_FREE 0xFF
+
+uint8_t midiChannelNotes[MIDI_MAX_CHANNEL_SLOTS][16];
+uint8_t midiSlotChannel[MIDI_MAX_CHANNEL_SLOTS];   // Kanal des Slots oder MIDI_SLOT_FREE
+
+// Vereinigung aller Kanäle (von allen Modi kombiniert) für LEDs und schnelle Tests
 uint8_t activeMidiNotes[16];
 
 #define IS_NOTE_ACTIVE(n) ((activeMidiNotes[(n) >> 3] >> ((n) & 7)) & 1)
-#define SET_NOTE_ACTIVE(n, v) if(v) activeMidiNotes[(n) >> 3] |= (1 << ((n) & 7)); else activeMidiNotes[(n) >> 3] &= ~(1 << ((n) & 7))
+#define IS_CHANNEL_NOTE_ACTIVE(s, n) ((midiChannelNotes[s][(n) >> 3] >> ((n) & 7)) & 1)
+
+// Voice Allocator: gesetztes Bit im Kanal-Bitset = ein Besitzer. Nur Stimmen mit
+// mehreren Besitzern (z.B. gemeinsame Akkordtöne, Arp + Hold) stehen zusätzlich
+// in der kleinen Overflow-Tabelle (statt RefCount[128] pro Layer)
+#define MIDI_VOICE_OVERFLOW_SLOTS 12
+
+struct MidiVoiceOverflow {
+  uint8_t pitch;
+  uint8_t info;       // Kanal im oberen Nibble, zusätzliche Besitzer (1-15) im unteren, 0 = frei
+};
+MidiVoiceOverflow midiVoiceOverflow[MIDI_VOICE_OVERFLOW_SLOTS];
+
+// Laufende Arpeggiator-Stimme (aus den ARP-Events mitgeführt, Kanal zum Zeitpunkt des Note On)
+uint8_t midiArpVoicePitch = 0xFF;      // 0xFF = keine
+uint8_t midiArpVoiceChannel = 0;
 
 #define IS_HOLD_NOTE_ACTIVE(n) ((holdModeMidiNotes[(n) >> 3] >> ((n) & 7)) & 1)
 #define SET_HOLD_NOTE_ACTIVE(n, v) if(v) holdModeMidiNotes[(n) >> 3] |= (1 << ((n) & 7)); else holdModeMidiNotes[(n) >> 3] &= ~(1 << ((n) & 7))
@@ -58,6 +198,10 @@ extern int getChordNote(int switchIndex, int variationType, int noteIndex);
 extern void removeNoteFromArpeggiatorMode(int note);
 extern void addNoteToArpeggiatorMode(int note);
 
+// Extern from MidiThru (SysEx-Stream: eigene Messages warten bis zum 0xF7)
+extern bool midiThruSysExStreaming;
+extern bool holdMidiThruMessage(uint8_t status, uint8_t data1, uint8_t data2);
+
 // ============================================
 // MIDI GENERATOR FUNCTIONS
 // ============================================
@@ -66,39 +210,592 @@ void initMidiGenerator() {
   for (int i = 0; i < 16; i++) {
     activeMidiNotes[i] = 0;
   }
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    midiSlotChannel[s] = MIDI_SLOT_FREE;
+    for (uint8_t i = 0; i < 16; i++) midiChannelNotes[s][i] = 0;
+  }
+  for (uint8_t i = 0; i < MIDI_VOICE_OVERFLOW_SLOTS; i++) {
+    midiVoiceOverflow[i].info = 0;
+  }
+  numStagedNotes = 0;
+  stagedEventMicros = 0;
+  midiArpVoicePitch = 0xFF;
+  clearMidiEvents();
+}
+
+/**
+ * Overflow-Eintrag einer Stimme suchen (-1 = nur ein Besitzer)
+ */
+int8_t findMidiVoiceOverflow(uint8_t channel, uint8_t pitch) {
+  for (uint8_t i = 0; i < MIDI_VOICE_OVERFLOW_SLOTS; i++) {
+    MidiVoiceOverflow &o = midiVoiceOverflow[i];
+    if (o.info != 0 && o.pitch == pitch && (o.info >> 4) == channel) return i;
+  }
+  return -1;
+}
+
+/**
+ * Slot eines Kanals suchen (-1 = auf dem Kanal klingt nichts)
+ */
+int8_t findMidiChannelSlot(uint8_t channel) {
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    if (midiSlotChannel[s] == channel) return s;
+  }
+  return -1;
+}
+
+/**
+ * Slot für einen Kanal suchen oder einen freien belegen (-1 = alle belegt)
+ */
+int8_t allocMidiChannelSlot(uint8_t channel) {
+  int8_t slot = findMidiChannelSlot(channel);
+  if (slot >= 0) return slot;
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    if (midiSlotChannel[s] == MIDI_SLOT_FREE) {
+      midiSlotChannel[s] = channel;
+      midiChannelsInUse |= (1U << channel);   // Für die Panic merken
+      return s;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Note im Kanal-Bitset setzen/löschen und die Vereinigung für dieses Byte
+ * nachführen (O(Slots) statt O(Noten)). Leere Slots werden wieder frei.
+ */
+void setChannelNoteActive(uint8_t slot, uint8_t pitch, bool on) {
+  uint8_t idx = pitch >> 3;
+  uint8_t bit = 1 << (pitch & 7);
+  if (on) {
+    midiChannelNotes[slot][idx] |= bit;
+    activeMidiNotes[idx] |= bit;
+    return;
+  }
+  midiChannelNotes[slot][idx] &= ~bit;
+  uint8_t merged = 0;
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) merged |= midiChannelNotes[s][idx];
+  activeMidiNotes[idx] = merged;
+
+  for (uint8_t i = 0; i < 16; i++) {
+    if (midiChannelNotes[slot][i]) return;
+  }
+  midiSlotChannel[slot] = MIDI_SLOT_FREE;
+}
+
+void resetNoteLatencyStats() {
+  noteLatencyStats.count = 0;
+  noteLatencyStats.last = 0;
+  noteLatencyStats.max = 0;
+  noteLatencyStats.sum = 0;
+}
+
+/**
+ * Mittlere Latenz Tasten-Event -> MIDI Ausgabe in µs
+ */
+uint16_t getAverageNoteLatency() {
+  if (noteLatencyStats.count == 0) return 0;
+  return noteLatencyStats.sum / noteLatencyStats.count;
 }
 
 /**
- * Sendet MIDI "All Notes Off" und schaltet alle aktiven Noten im Speicher aus.
- * Nützlich beim Bootup oder bei "Panic" Situationen.
+ * Running Status verwerfen: das nächste Channel-Message sendet wieder ein Status-Byte
+ */
+inline void resetMidiRunningStatus() {
+  midiRunningStatus = 0;
+}
+
+void writeMidiChannelMessage(uint8_t status, uint8_t data1, uint8_t data2);
+
+/**
+ * Output-Encoder für alle Channel Messages (Noten, CC, Aftertouch ...)
+ * - Note Off einheitlich nach MIDI_NOTE_OFF_AS_NOTE_ON
+ * - Status-Byte entfällt, wenn es dem letzten gesendeten entspricht (Running Status)
+ * - Realtime-Bytes (Clock) ändern den Running Status laut MIDI-Spezifikation nicht,
+ *   System Common/SysEx (0xF0-0xF7) setzen ihn zurück (sendMidiSystemByte)
+ */
+void sendMidiMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  uint8_t type = status & 0xF0;
+  uint8_t channel = status & 0x0F;
+#if MIDI_NOTE_OFF_AS_NOTE_ON
+  if (type == 0x80) {
+    status = 0x90 | channel;
+    data2 = 0;
+  }
+#else
+  if (type == 0x90 && data2 == 0) {
+    status = 0x80 | channel;
+  }
+#endif
+  writeMidiChannelMessage(status, data1, data2);
+}
+
+/**
+ * Channel Message unverändert senden (Running Status + USB-Spiegel), ohne
+ * Note-Off Normalisierung - auch für weitergeleitete Messages (MidiThru.h)
+ */
+void writeMidiChannelMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  // Weitergeleitete SysEx läuft gerade durch: erst nach deren 0xF7 senden (MidiThru.h)
+  if (midiThruSysExStreaming && holdMidiThruMessage(status, data1, data2)) return;
+  uint8_t type = status & 0xF0;
+  usbMidiQueueMessage(status, data1 & 0x7F, data2 & 0x7F);
+
+  unsigned long now = millis();
+  if (status != midiRunningStatus || now - midiRunningStatusTime >= MIDI_RUNNING_STATUS_REFRESH_MS) {
+    midiUartWrite(status);
+    midiRunningStatus = status;
+    midiRunningStatusTime = now;
+  }
+  midiUartWrite(data1 & 0x7F);
+  // Program Change und Channel Pressure haben nur ein Datenbyte
+  if (type != 0xC0 && type != 0xD0) {
+    midiUartWrite(data2 & 0x7F);
+  }
+}
+
+/**
+ * System Common Byte (0xF0-0xF7) senden - beendet den Running Status
+ */
+void sendMidiSystemByte(uint8_t b) {
+  midiUartWrite(b);
+  if (b < 0xF8) resetMidiRunningStatus();
+}
+
+/**
+ * Startet die Panic: schaltet alle aktiven Noten im Speicher sofort aus,
+ * gesendet wird asynchron in updateMidiPanic() (Bootup oder "Panic" Situationen).
  */
 void killAllMidiNotes() {
-  // Option 1: MIDI Control Change 123 (All Notes Off) auf Kanal 1
-  Serial1.write(0xB0); 
-  Serial1.write(123); 
-  Serial1.write(0);
-  
-  // Option 2: Explizite Note Offs für alle 128 Noten (Sicherheitsnetz)
-  for (int i = 0; i < 128; i++) {
-    Serial1.write(0x80); 
-    Serial1.write(i);
-    Serial1.write(0);
+  for (uint8_t l = 0; l < MIDI_NUM_LAYERS; l++) {
+    midiChannelsInUse |= (1U << midiLayerChannel[l]);
+  }
+  midiPanicNoteChannels = 0;
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    if (midiSlotChannel[s] != MIDI_SLOT_FREE) midiPanicNoteChannels |= (1U << midiSlotChannel[s]);
+  }
+  for (int i = 0; i < 16; i++) {
+    midiPanicNotes[i] = activeMidiNotes[i];
+  }
+  initMidiGenerator();
+  midiPanicState = PANIC_CONTROLLERS;
+  midiPanicChannel = 0;
+  midiPanicNote = 0;
+  // Status-Byte immer senden (Empfänger kann gerade erst angesteckt worden sein)
+  resetMidiRunningStatus();
+}
+
+/**
+ * Sendet so viel der laufenden Panic, wie gerade in den TX-Puffer passt
+ */
+void updateMidiPanic() {
+  while (midiPanicState != PANIC_IDLE && midiUartTxFree() >= 6) {
+    if (midiPanicState == PANIC_CONTROLLERS) {
+      if (midiPanicChannel >= 16) {
+        midiPanicState = PANIC_NOTES;
+        midiPanicChannel = 0;
+        continue;
+      }
+      uint8_t ch = midiPanicChannel++;
+      if (midiChannelsInUse & (1U << ch)) {
+        sendMidiMessage(0xB0 | ch, 123, 0);  // All Notes Off
+        sendMidiMessage(0xB0 | ch, 120, 0);  // All Sound Off
+      }
+    } else {
+      // Ganze leere Bytes überspringen
+      while (midiPanicNote < 128 && midiPanicNotes[midiPanicNote >> 3] == 0) {
+        midiPanicNote = (midiPanicNote + 8) & ~7;
+        midiPanicChannel = 0;
+      }
+      if (midiPanicNote >= 128) {
+        midiPanicState = PANIC_IDLE;
+        break;
+      }
+      uint8_t n = midiPanicNote;
+      // Ein Note Off pro Kanal, der beim Panic-Start Noten hatte
+      while (midiPanicChannel < 16 && !(midiPanicNoteChannels & (1U << midiPanicChannel))) {
+        midiPanicChannel++;
+      }
+      if (!IS_PANIC_NOTE(n) || midiPanicChannel >= 16) {
+        CLEAR_PANIC_NOTE(n);
+        midiPanicNote++;
+        midiPanicChannel = 0;
+        continue;
+      }
+      sendMidiMessage(0x90 | midiPanicChannel++, n, 0);
+    }
   }
-  for (int i = 0; i < 16; i++) activeMidiNotes[i] = 0;
 }
 
+void flushMidiTransaction();
+
 /**
  * Sende MIDI Note On oder Note Off
- * Inklusive State-Management für LEDs
+ * Der Kanal steht im unteren Nibble von cmd (Layer-Routing in processMidiEvent()).
+ * Inklusive State-Management für LEDs (Kanal-Bitsets sofort aktuell).
+ * Die Note wird nur im Transaktions-Puffer vorgemerkt, gesendet wird in flushMidiTransaction().
  */
 void sendMidiNote(int cmd, int pitch, int velocity) {
   if (pitch < 0 || pitch >= 128) return;
   
-  SET_NOTE_ACTIVE(pitch, (velocity > 0));
+  bool on = ((cmd & 0xF0) == 0x90) && velocity > 0;
+  uint8_t channel = cmd & 0x0F;
+  // Kein freier Slot: Note nicht spielen, sie könnte nie sicher beendet werden
+  int8_t slot = on ? allocMidiChannelSlot(channel) : findMidiChannelSlot(channel);
+  if (on && slot < 0) return;
+  bool wasActive = (slot >= 0) && IS_CHANNEL_NOTE_ACTIVE(slot, pitch);
+  
+  StagedNote *entry = 0;
+  for (uint8_t i = 0; i < numStagedNotes; i++) {
+    if (stagedNotes[i].pitch == pitch && (stagedNotes[i].flags >> 4) == channel) {
+      entry = &stagedNotes[i];
+      break;
+    }
+  }
+  if (!entry) {
+    if (!on && !wasActive) return;   // Note klingt auf diesem Kanal nicht
+    if (numStagedNotes >= MIDI_TX_MAX_STAGED) flushMidiTransaction(); // Voll: vorzeitig senden
+    entry = &stagedNotes[numStagedNotes++];
+    entry->pitch = pitch;
+    entry->flags = (channel << 4) | (wasActive ? STAGED_WAS_ACTIVE : 0);
+  }
+  if (!on) {
+    entry->flags |= STAGED_SAW_OFF;
+    // Note Off beendet die Stimme für alle Besitzer
+    int8_t o = findMidiVoiceOverflow(channel, pitch);
+    if (o >= 0) midiVoiceOverflow[o].info = 0;
+  }
+  entry->velocity = on ? velocity : 0;
+  
+  if (slot >= 0 && wasActive != on) setChannelNoteActive(slot, pitch, on);
+}
+
+/**
+ * Sendet alle vorgemerkten Note Events dieses Frames in einem Burst:
+ * erst alle Note Offs, dann alle Note Ons (Reihenfolge des Vormerkens).
+ * On+Off einer vorher stillen Note und doppelte Events entfallen.
+ */
+void flushMidiTransaction() {
+  if (numStagedNotes == 0) return;
+  
+  for (uint8_t i = 0; i < numStagedNotes; i++) {
+    StagedNote &e = stagedNotes[i];
+    if (!(e.flags & STAGED_WAS_ACTIVE)) continue;
+    bool retrigger = (e.velocity > 0) && (e.flags & STAGED_SAW_OFF) && !MIDI_TX_TIE_COMMON_NOTES;
+    if (e.velocity == 0 || retrigger) {
+      sendMidiMessage(0x90 | (e.flags >> 4), e.pitch, 0);
+    }
+  }
+  for (uint8_t i = 0; i < numStagedNotes; i++) {
+    StagedNote &e = stagedNotes[i];
+    if (e.velocity == 0) continue;
+    bool retrigger = (e.flags & STAGED_SAW_OFF) && !MIDI_TX_TIE_COMMON_NOTES;
+    if (midiPanicState != PANIC_IDLE && IS_PANIC_NOTE(e.pitch)) {
+      // Offenes Panic Note Off darf die neue Note nicht später abschneiden
+      CLEAR_PANIC_NOTE(e.pitch);
+      for (uint8_t ch = 0; ch < 16; ch++) {
+        if (midiPanicNoteChannels & (1U << ch)) sendMidiMessage(0x90 | ch, e.pitch, 0);
+      }
+    }
+    if (!(e.flags & STAGED_WAS_ACTIVE) || retrigger) {
+      sendMidiMessage(0x90 | (e.flags >> 4), e.pitch, e.velocity);
+    }
+  }
+  numStagedNotes = 0;
   
-  Serial1.write(cmd);
-  Serial1.write(pitch);
-  Serial1.write(velocity);
+  // Latenz nur für Frames, deren Noten direkt aus einem Tasten-Event entstehen
+  if (stagedEventMicros != 0 && noteLatencyStats.count < 0xFFFF) {
+    unsigned long latency = micros() - stagedEventMicros;
+    if (latency > 0xFFFF) latency = 0xFFFF;
+    noteLatencyStats.last = latency;
+    if (latency > noteLatencyStats.max) noteLatencyStats.max = latency;
+    noteLatencyStats.sum += latency;
+    noteLatencyStats.count++;
+  }
+  stagedEventMicros = 0;
+}
+
+/**
+ * Misst Bytes/s und Füllstand des TX-Puffers und schaltet das Traffic Shaping:
+ * an bei hoher Last oder vollem Puffer, aus erst bei deutlich geringerer Last
+ */
+void updateMidiBandwidthMeter() {
+  uint8_t depth = midiUartTxPending();
+  midiBandwidthStats.queueDepth = depth;
+  if (midiTxPeakDepth > midiBandwidthStats.peakQueueDepth) midiBandwidthStats.peakQueueDepth = midiTxPeakDepth;
+  midiTxPeakDepth = depth;
+  if (depth >= MIDI_SHAPER_QUEUE_ON) midiShapingActive = true;
+
+  unsigned long now = millis();
+  unsigned long elapsed = now - midiMeterWindowStart;
+  if (elapsed < MIDI_METER_WINDOW_MS) return;
+
+  uint16_t count = midiUartTxByteCount();
+  uint32_t rate = (uint32_t)(uint16_t)(count - midiMeterWindowBytes) * 1000 / elapsed;
+  midiMeterWindowBytes = count;
+  midiMeterWindowStart = now;
+  midiBandwidthStats.bytesPerSec = rate;
+  if (rate > midiBandwidthStats.peakBytesPerSec) midiBandwidthStats.peakBytesPerSec = rate;
+
+  if (rate * 100 >= (uint32_t)MIDI_DIN_BYTES_PER_SEC * MIDI_SHAPER_LOAD_ON) {
+    midiShapingActive = true;
+  } else if (rate * 100 < (uint32_t)MIDI_DIN_BYTES_PER_SEC * MIDI_SHAPER_LOAD_OFF &&
+             depth < MIDI_SHAPER_QUEUE_ON / 2) {
+    midiShapingActive = false;
+  }
+}
+
+void resetMidiBandwidthStats() {
+  midiBandwidthStats.peakBytesPerSec = 0;
+  midiBandwidthStats.peakQueueDepth = 0;
+  midiBandwidthStats.droppedAftertouch = 0;
+  midiBandwidthStats.coalescedControllers = 0;
+}
+
+/**
+ * Kontinuierlicher Controller (Mod Wheel, Expression, Filter ...): nur der letzte
+ * Wert zählt. Bank Select, RPN/NRPN mit Data Entry und Channel Mode Messages
+ * (120-127) hängen an der Reihenfolge und werden nie zusammengefasst.
+ */
+inline bool isMidiContinuousController(uint8_t controller) {
+  if (controller == 0 || controller == 32) return false;               // Bank Select MSB/LSB
+  if (controller == 6 || controller == 38) return false;               // Data Entry MSB/LSB
+  if (controller >= 96 && controller <= 101) return false;             // Inc/Dec, NRPN, RPN
+  return controller < 120;
+}
+
+/**
+ * Control Change senden. Bei freier Leitung sofort, beim Shaping wird nur der
+ * letzte Wert pro Kanal/Controller gemerkt und in flushPendingControllers() gesendet.
+ * Quelle sind bisher nur die weitergeleiteten CCs des Soft-Thru (MidiThru.h).
+ */
+void sendMidiControlChange(uint8_t channel, uint8_t controller, uint8_t value) {
+  uint8_t status = 0xB0 | (channel & 0x0F);
+  if (!isMidiContinuousController(controller)) {
+    sendMidiMessage(status, controller, value);
+    return;
+  }
+  int8_t freeSlot = -1;
+  for (uint8_t i = 0; i < MIDI_CC_COALESCE_SLOTS; i++) {
+    PendingController &p = pendingControllers[i];
+    if (p.status == status && p.controller == controller) {
+      p.value = value;   // Älterer Wert wurde nie gesendet
+      midiBandwidthStats.coalescedControllers++;
+      return;
+    }
+    if (p.status == 0 && freeSlot < 0) freeSlot = i;
+  }
+  if (!midiShapingActive || freeSlot < 0) {
+    sendMidiMessage(status, controller, value);
+    return;
+  }
+  pendingControllers[freeSlot].status = status;
+  pendingControllers[freeSlot].controller = controller;
+  pendingControllers[freeSlot].value = value;
+}
+
+/**
+ * Zusammengefasste CCs senden: ohne Shaping sofort, sonst gedrosselt und nur,
+ * solange im TX-Puffer Platz für Noten bleibt
+ */
+void flushPendingControllers() {
+  unsigned long now = millis();
+  if (midiShapingActive && now - pendingControllersTime < MIDI_SHAPER_CC_INTERVAL_MS) return;
+  pendingControllersTime = now;
+  for (uint8_t i = 0; i < MIDI_CC_COALESCE_SLOTS; i++) {
+    PendingController &p = pendingControllers[i];
+    if (p.status == 0) continue;
+    if (midiShapingActive && midiUartTxFree() < MIDI_AFTERTOUCH_MIN_TX_FREE) return;
+    sendMidiMessage(p.status, p.controller, p.value);
+    p.status = 0;
+  }
+}
+
+/**
+ * Stimme (Kanal aus dem Status-Byte 0x9n, Tonhöhe) belegen.
+ * Note On nur, wenn die Stimme noch keinen Besitzer hat, sonst wird nur gezählt.
+ */
+void acquireMidiVoice(uint8_t status, int pitch, uint8_t velocity) {
+  if (pitch < 0 || pitch >= 128) return;
+  uint8_t channel = status & 0x0F;
+  int8_t slot = findMidiChannelSlot(channel);
+  if (slot < 0 || !IS_CHANNEL_NOTE_ACTIVE(slot, pitch)) {
+    sendMidiNote(0x90 | channel, pitch, velocity);
+    return;
+  }
+
+  int8_t o = findMidiVoiceOverflow(channel, pitch);
+  if (o >= 0) {
+    if ((midiVoiceOverflow[o].info & 0x0F) < 0x0F) midiVoiceOverflow[o].info++;
+    return;
+  }
+  for (uint8_t i = 0; i < MIDI_VOICE_OVERFLOW_SLOTS; i++) {
+    if (midiVoiceOverflow[i].info == 0) {
+      midiVoiceOverflow[i].pitch = pitch;
+      midiVoiceOverflow[i].info = (channel << 4) | 1;
+      return;
+    }
+  }
+  // Tabelle voll: Besitzer nicht zählbar, die Stimme endet beim ersten Release
+}
+
+/**
+ * Stimme freigeben: Note Off erst, wenn der letzte Besitzer losgelassen hat
+ */
+void releaseMidiVoice(uint8_t channel, int pitch) {
+  if (pitch < 0 || pitch >= 128) return;
+  int8_t slot = findMidiChannelSlot(channel);
+  if (slot < 0 || !IS_CHANNEL_NOTE_ACTIVE(slot, pitch)) return;
+
+  int8_t o = findMidiVoiceOverflow(channel, pitch);
+  if (o >= 0) {
+    midiVoiceOverflow[o].info--;
+    if ((midiVoiceOverflow[o].info & 0x0F) == 0) midiVoiceOverflow[o].info = 0;
+    return;
+  }
+  sendMidiNote(0x90 | channel, pitch, 0x00);
+}
+
+/**
+ * Anzahl Besitzer einer Stimme (0 = klingt nicht)
+ */
+uint8_t getMidiVoiceOwners(uint8_t slot, uint8_t pitch) {
+  if (!IS_CHANNEL_NOTE_ACTIVE(slot, pitch)) return 0;
+  int8_t o = findMidiVoiceOverflow(midiSlotChannel[slot], pitch);
+  return (o >= 0) ? 1 + (midiVoiceOverflow[o].info & 0x0F) : 1;
+}
+
+/**
+ * Slot, auf dem eine Tasten-Note (Keys/Hold/Chord/Bass) klingt - der Kanal beim
+ * Note On hängt vom Routing und Modus ab. Die laufende Arpeggiator-Stimme zählt
+ * nur mit, wenn sie zusätzlich einen Tasten-Besitzer hat. -1 = keiner
+ */
+int8_t findKeyNoteSlot(uint8_t pitch) {
+  int8_t arpSlot = -1;
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    uint8_t ch = midiSlotChannel[s];
+    if (ch == MIDI_SLOT_FREE || !IS_CHANNEL_NOTE_ACTIVE(s, pitch)) continue;
+    if (pitch == midiArpVoicePitch && ch == midiArpVoiceChannel) {
+      arpSlot = s;
+      continue;
+    }
+    return s;
+  }
+  if (arpSlot >= 0 && getMidiVoiceOwners(arpSlot, pitch) > 1) return arpSlot;
+  return -1;
+}
+
+/**
+ * Einen Tasten-Besitzer auf genau dem Kanal freigeben, auf dem die Note eingeschaltet
+ * wurde. Klingt dort nur die laufende Arpeggiator-Stimme, bleibt sie stehen.
+ */
+void releaseMidiKeyVoice(uint8_t channel, uint8_t pitch) {
+  if (pitch == midiArpVoicePitch && channel == midiArpVoiceChannel) {
+    int8_t slot = findMidiChannelSlot(channel);
+    if (slot < 0 || getMidiVoiceOwners(slot, pitch) <= 1) return;
+  }
+  releaseMidiVoice(channel, pitch);
+}
+
+/**
+ * Alle Tasten-Besitzer einer Note freigeben (Hold/Chord komplett aus).
+ * Die laufende Arpeggiator-Stimme behält ihren eigenen Besitzer.
+ */
+void releaseMidiNoteAll(int pitch) {
+  if (pitch < 0 || pitch >= 128 || !IS_NOTE_ACTIVE(pitch)) return;
+  int8_t slot;
+  while ((slot = findKeyNoteSlot(pitch)) >= 0) {
+    releaseMidiVoice(midiSlotChannel[slot], pitch);
+  }
+}
+
+/**
+ * Sende Polyphonic Aftertouch (0xAn) für eine aktive Note, auf jedem Kanal, auf dem sie klingt.
+ * Rückgabe false, wenn das Bandbreiten-Budget gerade erschöpft ist oder das
+ * Traffic Shaping läuft (der Aufrufer versucht es in einem späteren Frame mit
+ * dem dann aktuellen Druck erneut - veraltete Werte werden nie nachgesendet).
+ */
+bool sendMidiPolyPressure(int pitch, int pressure) {
+  if (pitch < 0 || pitch >= 128) return true;
+  // Note On noch auf dem Event Bus oder im Transaktions-Puffer: Aftertouch erst im nächsten Frame
+  if (isMidiNoteOnPending(pitch)) return false;
+  if (!IS_NOTE_ACTIVE(pitch)) return true;
+  if (midiThruSysExStreaming) return false;   // Nicht den Wartepuffer des SysEx-Streams füllen
+  if (midiShapingActive) {
+    midiBandwidthStats.droppedAftertouch++;
+    return false;
+  }
+  for (uint8_t i = 0; i < numStagedNotes; i++) {
+    if (stagedNotes[i].pitch == pitch) return false;
+  }
+
+  unsigned long now = millis();
+  unsigned long elapsed = now - midiAftertouchRefillTime;
+  if (elapsed > 0) {
+    midiAftertouchRefillTime = now;
+    uint32_t credit = midiAftertouchCredit + elapsed * MIDI_AFTERTOUCH_CREDIT_PER_MS;
+    midiAftertouchCredit = (credit > MIDI_AFTERTOUCH_CREDIT_MAX) ? MIDI_AFTERTOUCH_CREDIT_MAX : credit;
+  }
+
+  uint8_t numChannels = 0;
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    if (midiSlotChannel[s] != MIDI_SLOT_FREE && IS_CHANNEL_NOTE_ACTIVE(s, pitch)) numChannels++;
+  }
+  uint16_t cost = numChannels * MIDI_AFTERTOUCH_MESSAGE_COST;
+  if (midiAftertouchCredit < cost) return false;
+  if (midiUartTxFree() < MIDI_AFTERTOUCH_MIN_TX_FREE) return false;
+  midiAftertouchCredit -= cost;
+
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    if (midiSlotChannel[s] != MIDI_SLOT_FREE && IS_CHANNEL_NOTE_ACTIVE(s, pitch)) {
+      sendMidiMessage(0xA0 | midiSlotChannel[s], pitch, pressure);
+    }
+  }
+  return true;
+}
+
+/**
+ * Ein Event vom Bus ausführen: Kanal aus dem Layer-Routing, Tasten-Layer
+ * teilen sich die Voice-Zählung, der Arpeggiator gibt nur seine eigene Stimme frei
+ */
+void processMidiEvent(MidiEvent e) {
+  uint8_t layer = MIDI_EVENT_LAYER(e);
+  if (layer >= MIDI_NUM_LAYERS) return;
+  uint8_t channel = (e.channel != MIDI_CHANNEL_ROUTED) ? (e.channel & 0x0F) : midiLayerChannel[layer];
+
+  switch (MIDI_EVENT_KIND(e)) {
+    case MIDI_EVENT_NOTE_ON:
+      if (layer == MIDI_LAYER_ARP) {
+        midiArpVoicePitch = e.pitch;
+        midiArpVoiceChannel = channel;
+      }
+      acquireMidiVoice(0x90 | channel, e.pitch, e.velocity);
+      break;
+    case MIDI_EVENT_NOTE_OFF:
+      if (layer == MIDI_LAYER_ARP) {
+        if (e.pitch != midiArpVoicePitch) break;
+        midiArpVoicePitch = 0xFF;
+        releaseMidiVoice(midiArpVoiceChannel, e.pitch);
+      } else {
+        releaseMidiKeyVoice(channel, e.pitch);
+      }
+      break;
+    case MIDI_EVENT_NOTE_OFF_ALL:
+      releaseMidiNoteAll(e.pitch);
+      break;
+  }
+}
+
+/**
+ * Event Bus leeren (in Post-Reihenfolge), Ergebnis landet im Transaktions-Puffer
+ */
+void processMidiEvents() {
+  if (midiEventMicros != 0 && stagedEventMicros == 0) stagedEventMicros = midiEventMicros;
+  midiEventMicros = 0;
+  MidiEvent e;
+  while (peekMidiEvent(e)) {
+    dropMidiEvent();
+    processMidiEvent(e);
+  }
 }
 
 /**
@@ -107,16 +804,28 @@ void sendMidiNote(int cmd, int pitch, int velocity) {
  * welche Noten gespielt werden sollen (State Sync)
  */
 void updateMidiGenerator() {
-  // Aktuell primär eventbasiert, State Sync Logik hier möglich
+  // Laufende Panic weitersenden, dann alle in diesem Durchlauf geposteten
+  // Note Events als ein Burst, zuletzt zusammengefasste CCs
+  updateMidiBandwidthMeter();
+  updateMidiPanic();
+  processMidiEvents();
+  flushMidiTransaction();
+  flushPendingControllers();
 }
 
 /**
  * Stoppe alle MIDI-Noten
  */
 void stopAllMidiNotes() {
-  for (int note = 0; note < 128; note++) {
-    if (IS_NOTE_ACTIVE(note)) {
-      sendMidiNote(0x90, note, 0x00);  // Note Off via Velocity 0
+  for (uint8_t s = 0; s < MIDI_MAX_CHANNEL_SLOTS; s++) {
+    uint8_t ch = midiSlotChannel[s];
+    if (ch == MIDI_SLOT_FREE) continue;
+    // Ganze leere Bytes überspringen (der Slot wird mit der letzten Note frei)
+    for (uint8_t i = 0; i < 16; i++) {
+      uint8_t bits = midiChannelNotes[s][i];
+      for (uint8_t b = 0; bits; b++, bits >>= 1) {
+        if (bits & 1) sendMidiNote(0x90 | ch, (i << 3) + b, 0x00);  // Note Off via Velocity 0
+      }
     }
   }
 }
@@ -126,6 +835,7 @@ void stopAllMidiNotes() {
  */
 void resetMidiGenerator() {
   stopAllMidiNotes();
+  flushMidiTransaction();   // Note Offs senden, bevor initMidiGenerator() den Puffer verwirft
   initMidiGenerator();
 }
 
@@ -0,0 +1,195 @@
+/**
+ * MIDI INPUT PARSER
+ *
+ * Zustandsautomat für den DIN MIDI Eingang (ohne MIDI Library, ohne malloc):
+ * - Running Status, auch nach eingestreuten Realtime-Bytes
+ * - Realtime-Bytes (0xF8-0xFF) dürfen überall stehen, auch mitten in einer
+ *   Message oder SysEx, und ändern den Parser-Zustand nicht
+ * - SysEx wird gestreamt (Byte für Byte an den Handler oder übersprungen),
+ *   nie komplett gepuffert
+ * - Typisierte Handler (Note, CC, Program Change, SPP, Clock/Start/Continue/Stop)
+ *   plus ein generischer Handler pro vollständiger Message (Soft-Thru)
+ * - O(1) pro Byte, nicht gesetzte Handler (0) werden übersprungen
+ *
+ * INPUT:
+ *   - midiParserInput() mit jedem empfangenen Byte (MIDI Clock Receiver)
+ * OUTPUT:
+ *   - Aufrufe der Handler in midiInputHandlers
+ */
+
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+
+#include "arduino_stubs.h"
+
+// ============================================
+// MIDI PARSER HANDLERS
+// ============================================
+
+struct MidiInputHandlers {
+  // Channel Messages (Kanal 0-15); Note On mit Velocity 0 kommt als Note Off
+  void (*noteOn)(uint8_t channel, uint8_t note, uint8_t velocity);
+  void (*noteOff)(uint8_t channel, uint8_t note, uint8_t velocity);
+  void (*controlChange)(uint8_t channel, uint8_t controller, uint8_t value);
+  void (*programChange)(uint8_t channel, uint8_t program);
+  // System Common
+  void (*songPosition)(uint16_t beats);   // In 16teln (6 Clocks)
+  // System Realtime
+  void (*clock)();
+  void (*start)();
+  void (*cont)();
+  void (*stop)();
+  // Roh: jede vollständige Channel/System Common Message (Running Status aufgelöst),
+  // jedes Realtime-Byte und der SysEx-Stream (inkl. 0xF0/0xF7)
+  void (*message)(uint8_t status, uint8_t data1, uint8_t data2);
+  void (*realtime)(uint8_t b);
+  void (*sysExByte)(uint8_t b);
+  void (*sysExEnd)(bool complete);       // false = durch ein Status-Byte abgebrochen
+};
+MidiInputHandlers midiInputHandlers;
+
+// ============================================
+// MIDI PARSER STATE
+// ============================================
+
+uint8_t midiParserRunningStatus = 0;   // 0 = keiner
+uint8_t midiParserPending = 0;         // Status der gerade gesammelten Message (0 = keine)
+uint8_t midiParserData[2];
+uint8_t midiParserDataCount = 0;
+uint8_t midiParserDataLength = 0;
+bool midiParserInSysEx = false;
+
+// ============================================
+// MIDI PARSER FUNCTIONS
+// ============================================
+
+/**
+ * Anzahl Datenbytes zu einem Status-Byte (Channel / System Common)
+ */
+uint8_t getMidiDataLength(uint8_t status) {
+  switch (status & 0xF0) {
+    case 0xC0:
+    case 0xD0:
+      return 1;
+    case 0xF0:
+      if (status == 0xF1 || status == 0xF3) return 1;   // MTC Quarter Frame, Song Select
+      if (status == 0xF2) return 2;                     // Song Position Pointer
+      return 0;                                         // Tune Request
+    default:
+      return 2;
+  }
+}
+
+void initMidiParser() {
+  midiParserRunningStatus = 0;
+  midiParserPending = 0;
+  midiParserDataCount = 0;
+  midiParserInSysEx = false;
+}
+
+/**
+ * Realtime-Byte verteilen (Parser-Zustand bleibt unverändert)
+ */
+void dispatchMidiRealtime(uint8_t b) {
+  if (midiInputHandlers.realtime) midiInputHandlers.realtime(b);
+  switch (b) {
+    case 0xF8: if (midiInputHandlers.clock) midiInputHandlers.clock(); break;
+    case 0xFA: if (midiInputHandlers.start) midiInputHandlers.start(); break;
+    case 0xFB: if (midiInputHandlers.cont) midiInputHandlers.cont(); break;
+    case 0xFC: if (midiInputHandlers.stop) midiInputHandlers.stop(); break;
+    // Active Sensing, Reset und undefinierte Bytes nur roh
+  }
+}
+
+/**
+ * Vollständige Message verteilen
+ */
+void dispatchMidiMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  if (midiInputHandlers.message) midiInputHandlers.message(status, data1, data2);
+  uint8_t channel = status & 0x0F;
+  switch (status & 0xF0) {
+    case 0x90:
+      if (data2 > 0) {
+        if (midiInputHandlers.noteOn) midiInputHandlers.noteOn(channel, data1, data2);
+        break;
+      }
+      // Velocity 0 = Note Off, fall through
+    case 0x80:
+      if (midiInputHandlers.noteOff) midiInputHandlers.noteOff(channel, data1, data2);
+      break;
+    case 0xB0:
+      if (midiInputHandlers.controlChange) midiInputHandlers.controlChange(channel, data1, data2);
+      break;
+    case 0xC0:
+      if (midiInputHandlers.programChange) midiInputHandlers.programChange(channel, data1);
+      break;
+    case 0xF0:
+      if (status == 0xF2 && midiInputHandlers.songPosition) {
+        midiInputHandlers.songPosition(data1 | ((uint16_t)data2 << 7));
+      }
+      break;
+  }
+}
+
+/**
+ * SysEx beenden (vollständig oder abgebrochen)
+ */
+void endMidiSysEx(bool complete) {
+  midiParserInSysEx = false;
+  if (midiInputHandlers.sysExEnd) midiInputHandlers.sysExEnd(complete);
+}
+
+/**
+ * Ein empfangenes Byte in den Parser
+ */
+void midiParserInput(uint8_t b) {
+  if (b >= 0xF8) {
+    dispatchMidiRealtime(b);
+    return;
+  }
+
+  if (midiParserInSysEx) {
+    if (b < 0x80 || b == 0xF7) {
+      if (midiInputHandlers.sysExByte) midiInputHandlers.sysExByte(b);
+      if (b == 0xF7) endMidiSysEx(true);
+      return;
+    }
+    // Status-Byte ohne 0xF7: SysEx abgebrochen, Byte normal auswerten
+    endMidiSysEx(false);
+  }
+
+  if (b >= 0x80) {
+    midiParserDataCount = 0;
+    midiParserPending = 0;
+    // System Common und SysEx beenden den Running Status
+    midiParserRunningStatus = (b < 0xF0) ? b : 0;
+    if (b == 0xF0) {
+      midiParserInSysEx = true;
+      if (midiInputHandlers.sysExByte) midiInputHandlers.sysExByte(b);
+      return;
+    }
+    midiParserDataLength = getMidiDataLength(b);
+    if (midiParserDataLength > 0) {
+      midiParserPending = b;
+    } else if (b == 0xF6) {
+      dispatchMidiMessage(b, 0, 0);   // Undefinierte (0xF4/0xF5) und loses 0xF7 verwerfen
+    }
+    return;
+  }
+
+  // Datenbyte: ohne neues Status-Byte gilt der Running Status
+  if (midiParserPending == 0) {
+    if (midiParserRunningStatus == 0) return;   // Datenbyte ohne Status: verwerfen
+    midiParserPending = midiParserRunningStatus;
+    midiParserDataLength = getMidiDataLength(midiParserRunningStatus);
+  }
+  midiParserData[midiParserDataCount++] = b;
+  if (midiParserDataCount < midiParserDataLength) return;
+
+  uint8_t status = midiParserPending;
+  midiParserDataCount = 0;
+  midiParserPending = 0;
+  dispatchMidiMessage(status, midiParserData[0], (midiParserDataLength > 1) ? midiParserData[1] : 0);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * MIDI ROUTING
+ *
+ * Zuordnung der Noten-Quellen (Layer) zu MIDI-Kanälen:
+ * - Direkt gespielte Noten, Hold-Noten, Akkord-Noten, Akkord-Grundton (Bass)
+ *   und Arpeggiator können jeweils auf einem eigenen Kanal liegen
+ * - Default: alles auf Kanal 1 (wie bisher)
+ * - Note Events tragen nur ihren Layer (MidiEventBus.h), den Kanal wählt der
+ *   MIDI Generator beim Note On; Note Offs gehen an den Kanal, auf dem die Note
+ *   wirklich klingt
+ *
+ * INPUT:
+ *   - MIDI_CHANNEL_* Defines (Kanal 1-16) bzw. setMidiLayerChannel() zur Laufzeit
+ * OUTPUT:
+ *   - midiLayerChannel[] (Kanal 0-15 pro Layer) für Software Controller,
+ *     Chord Mode, Arpeggiator und MIDI Generator
+ */
+
+#ifndef MIDI_ROUTING_H
+#define MIDI_ROUTING_H
+
+#include "arduino_stubs.h"
+
+// ============================================
+// MIDI ROUTING CONFIG
+// ============================================
+
+#define MIDI_LAYER_KEYS   0   // Direkt gespielte Noten (momentary)
+#define MIDI_LAYER_HOLD   1   // Per Hold Mode gehaltene Noten
+#define MIDI_LAYER_CHORD  2   // Akkord-Noten (ohne Grundton)
+#define MIDI_LAYER_BASS   3   // Grundton der Akkorde
+#define MIDI_LAYER_ARP    4   // Arpeggiator
+#define MIDI_NUM_LAYERS   5
+
+// MIDI Kanal pro Layer (1-16)
+#ifndef MIDI_CHANNEL_KEYS
+#define MIDI_CHANNEL_KEYS   1
+#endif
+#ifndef MIDI_CHANNEL_HOLD
+#define MIDI_CHANNEL_HOLD   1
+#endif
+#ifndef MIDI_CHANNEL_CHORD
+#define MIDI_CHANNEL_CHORD  1
+#endif
+#ifndef MIDI_CHANNEL_BASS
+#define MIDI_CHANNEL_BASS   1
+#endif
+#ifndef MIDI_CHANNEL_ARP
+#define MIDI_CHANNEL_ARP    1
+#endif
+
+// ============================================
+// MIDI ROUTING STATE
+// ============================================
+
+uint8_t midiLayerChannel[MIDI_NUM_LAYERS] = {
+  MIDI_CHANNEL_KEYS - 1,
+  MIDI_CHANNEL_HOLD - 1,
+  MIDI_CHANNEL_CHORD - 1,
+  MIDI_CHANNEL_BASS - 1,
+  MIDI_CHANNEL_ARP - 1
+};
+
+// ============================================
+// MIDI ROUTING FUNCTIONS
+// ============================================
+
+/**
+ * Layer einer Tasten-Note: Akkord-Grundton -> Bass, übrige Akkord-Noten -> Chord,
+ * sonst Hold oder direkt gespielt
+ */
+inline uint8_t getKeyNoteLayer(bool chord, bool root, bool hold) {
+  if (chord) return root ? MIDI_LAYER_BASS : MIDI_LAYER_CHORD;
+  return hold ? MIDI_LAYER_HOLD : MIDI_LAYER_KEYS;
+}
+
+/**
+ * Kanal eines Layers zur Laufzeit ändern (channel 1-16).
+ * Bereits klingende Noten bleiben auf dem alten Kanal getrackt und
+ * werden dort auch wieder ausgeschaltet.
+ */
+void setMidiLayerChannel(uint8_t layer, uint8_t channel) {
+  if (layer >= MIDI_NUM_LAYERS || channel < 1 || channel > 16) return;
+  midiLayerChannel[layer] = channel - 1;
+}
+
+#endif
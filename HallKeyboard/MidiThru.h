@@ -0,0 +1,261 @@
+/**
+ * MIDI THRU LAYER (Soft-Thru / Merge)
+ *
+ * Leitet den DIN MIDI Eingang an den Ausgang weiter und mischt ihn mit den
+ * eigenen Messages (Keyboard in der Mitte einer MIDI-Kette, ohne Merger-Box):
+ * - Standardmäßig aus (MIDI_THRU_DEFAULT): schickt eine DAW an das Keyboard und
+ *   nimmt dessen Ausgang auf, entstünde sonst eine MIDI-Schleife
+ * - Realtime-Bytes gehen direkt im RX-ISR in die Realtime-Queue (MidiUart.h),
+ *   hier nur der USB-Spiegel
+ * - Channel und System Common Messages kommen vom Parser komplett (Running
+ *   Status des Eingangs aufgelöst) und werden als Ganzes in den TX-Puffer geschrieben
+ *   -> eigene und weitergeleitete Messages mischen sich nur an Message-Grenzen
+ * - Control Changes laufen über sendMidiControlChange() (MidiGenerator.h): bei
+ *   überlasteter Leitung zählt pro Kanal/Controller nur der letzte Wert
+ * - Eine Message geht raus, sobald ihr letztes Byte da ist: keine Verzögerung
+ *   über die Übertragungszeit der Message selbst hinaus
+ * - SysEx bis MIDI_THRU_SYSEX_MAX Bytes wird gepuffert und als Block
+ *   weitergeleitet. Längere SysEx wird durchgestreamt; solange sie läuft, warten
+ *   eigene Channel Messages in einem kleinen Puffer (holdMidiThruMessage()) und
+ *   folgen direkt nach dem 0xF7. Läuft dieser Puffer voll oder stockt der Stream,
+ *   wird die SysEx mit 0xF7 abgeschlossen (midiThruStats.truncatedSysEx)
+ *
+ * INPUT:
+ *   - Message-, Realtime- und SysEx-Handler des MIDI Input Parsers (MidiParser.h)
+ *   - Eigene Channel Messages während eines SysEx-Streams (writeMidiChannelMessage)
+ * OUTPUT:
+ *   - Weitergeleitete Messages via MIDI Output-Encoder (DIN + USB)
+ *   - midiThruStats
+ */
+
+#ifndef MIDI_THRU_H
+#define MIDI_THRU_H
+
+#include "MidiUart.h"
+#include "UsbMidi.h"
+#include "MidiParser.h"
+
+// ============================================
+// MIDI THRU CONFIG
+// ============================================
+
+#ifndef MIDI_THRU_DEFAULT
+#define MIDI_THRU_DEFAULT false
+#endif
+
+#define MIDI_THRU_SYSEX_MAX        24    // Inkl. 0xF0/0xF7, kürzere SysEx als Block
+#define MIDI_THRU_HOLD_MESSAGES    8     // Eigene Messages, die auf das Ende eines SysEx-Streams warten
+#define MIDI_THRU_SYSEX_TIMEOUT_MS 100   // Stream ohne neues Byte -> abschließen
+
+#define MIDI_THRU_SYSEX_IDLE    0
+#define MIDI_THRU_SYSEX_BUFFER  1    // Sammeln bis MIDI_THRU_SYSEX_MAX
+#define MIDI_THRU_SYSEX_STREAM  2    // Direkt weiterleiten, eigene Messages warten
+#define MIDI_THRU_SYSEX_SKIP    3    // Stream abgebrochen: Rest bis zum Ende verwerfen
+
+// ============================================
+// MIDI THRU STATE
+// ============================================
+
+bool midiThruEnabled = MIDI_THRU_DEFAULT;
+
+uint8_t midiThruSysEx[MIDI_THRU_SYSEX_MAX];
+uint8_t midiThruSysExLength = 0;
+uint8_t midiThruSysExState = MIDI_THRU_SYSEX_IDLE;
+bool midiThruSysExStreaming = false;           // Von writeMidiChannelMessage() geprüft
+unsigned long midiThruSysExByteTime = 0;
+
+// Eigene Channel Messages während eines Streams
+struct MidiThruHeldMessage {
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+MidiThruHeldMessage midiThruHeld[MIDI_THRU_HOLD_MESSAGES];
+uint8_t midiThruHeldCount = 0;
+
+struct MidiThruStats {
+  uint16_t forwarded;       // Weitergeleitete Messages (ohne Realtime)
+  uint16_t streamedSysEx;   // Durchgestreamte lange SysEx Messages
+  uint16_t droppedSysEx;    // Abgebrochene SysEx Messages (vor dem ersten Byte am Ausgang)
+  uint16_t truncatedSysEx;  // Gestreamte SysEx vorzeitig mit 0xF7 abgeschlossen
+};
+MidiThruStats midiThruStats;
+
+extern void writeMidiChannelMessage(uint8_t status, uint8_t data1, uint8_t data2);
+extern void resetMidiRunningStatus();
+extern void sendMidiControlChange(uint8_t channel, uint8_t controller, uint8_t value);
+
+// ============================================
+// MIDI THRU FUNCTIONS
+// ============================================
+
+/**
+ * Vollständige Message vom Parser weiterleiten (System Common beendet den Running Status)
+ */
+void midiThruMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  if (!midiThruEnabled) return;
+  if ((status & 0xF0) == 0xB0) {
+    sendMidiControlChange(status & 0x0F, data1, data2);
+  } else if (status < 0xF0) {
+    writeMidiChannelMessage(status, data1, data2);
+  } else {
+    uint8_t length = getMidiDataLength(status);
+    midiUartWrite(status);
+    if (length > 0) midiUartWrite(data1);
+    if (length > 1) midiUartWrite(data2);
+    resetMidiRunningStatus();
+    usbMidiQueueSystem(status, data1, data2, length + 1);
+  }
+  midiThruStats.forwarded++;
+}
+
+/**
+ * USB: vollständige 3-Byte Gruppen des Streams senden, den Rest im Puffer
+ * behalten (mit 'end' alles, der Puffer endet dann mit 0xF7)
+ */
+void flushMidiThruSysExUsb(bool end) {
+  uint8_t length = end ? midiThruSysExLength : midiThruSysExLength - midiThruSysExLength % 3;
+  usbMidiQueueSysExChunk(midiThruSysEx, length, end);
+  for (uint8_t i = length; i < midiThruSysExLength; i++) midiThruSysEx[i - length] = midiThruSysEx[i];
+  midiThruSysExLength -= length;
+}
+
+/**
+ * Stream beenden und die wartenden eigenen Messages senden
+ */
+void endMidiThruSysExStream() {
+  midiThruSysExStreaming = false;
+  resetMidiRunningStatus();
+  for (uint8_t i = 0; i < midiThruHeldCount; i++) {
+    writeMidiChannelMessage(midiThruHeld[i].status, midiThruHeld[i].data1, midiThruHeld[i].data2);
+  }
+  midiThruHeldCount = 0;
+}
+
+/**
+ * Laufenden Stream vorzeitig mit 0xF7 abschließen, Rest der Eingangs-SysEx verwerfen
+ */
+void truncateMidiThruSysEx() {
+  midiUartWrite(0xF7);
+  midiThruSysEx[midiThruSysExLength++] = 0xF7;   // Platz ist da: höchstens 2 Bytes im Puffer
+  flushMidiThruSysExUsb(true);
+  midiThruSysExState = MIDI_THRU_SYSEX_SKIP;
+  midiThruStats.truncatedSysEx++;
+  endMidiThruSysExStream();
+}
+
+/**
+ * Eigene Channel Message, während ein SysEx-Stream läuft (aus writeMidiChannelMessage).
+ * Rückgabe false: Puffer voll, der Stream wurde abgeschlossen -> sofort senden.
+ */
+bool holdMidiThruMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  if (midiThruHeldCount >= MIDI_THRU_HOLD_MESSAGES) {
+    truncateMidiThruSysEx();
+    return false;
+  }
+  midiThruHeld[midiThruHeldCount].status = status;
+  midiThruHeld[midiThruHeldCount].data1 = data1;
+  midiThruHeld[midiThruHeldCount].data2 = data2;
+  midiThruHeldCount++;
+  return true;
+}
+
+/**
+ * SysEx-Byte vom Parser: kurze Messages sammeln, lange durchstreamen
+ */
+void midiThruSysExByte(uint8_t b) {
+  if (!midiThruEnabled) return;
+  if (b == 0xF0) {
+    midiThruSysExLength = 0;
+    midiThruSysExState = MIDI_THRU_SYSEX_BUFFER;
+  }
+  midiThruSysExByteTime = millis();
+
+  switch (midiThruSysExState) {
+    case MIDI_THRU_SYSEX_BUFFER:
+      if (midiThruSysExLength < MIDI_THRU_SYSEX_MAX) {
+        midiThruSysEx[midiThruSysExLength++] = b;
+        return;
+      }
+      // Zu lang für den Puffer: Gesammeltes senden, ab jetzt streamen
+      for (uint8_t i = 0; i < midiThruSysExLength; i++) midiUartWrite(midiThruSysEx[i]);
+      flushMidiThruSysExUsb(false);
+      midiThruSysExState = MIDI_THRU_SYSEX_STREAM;
+      midiThruSysExStreaming = true;
+      // Fallthrough: aktuelles Byte streamen
+
+    case MIDI_THRU_SYSEX_STREAM:
+      midiUartWrite(b);
+      midiThruSysEx[midiThruSysExLength++] = b;
+      if (midiThruSysExLength >= 3 && b != 0xF7) flushMidiThruSysExUsb(false);
+      break;
+
+    default:
+      break;   // IDLE (Thru erst während der SysEx eingeschaltet) oder SKIP
+  }
+}
+
+/**
+ * Ende der SysEx: gepufferte als Block weiterleiten, Stream abschließen
+ */
+void midiThruSysExEnd(bool complete) {
+  uint8_t state = midiThruSysExState;
+  midiThruSysExState = MIDI_THRU_SYSEX_IDLE;
+  if (!midiThruEnabled) return;
+
+  if (state == MIDI_THRU_SYSEX_STREAM) {
+    if (!complete) {
+      // Eingang durch ein Status-Byte abgebrochen: Ausgang sauber beenden
+      truncateMidiThruSysEx();
+      midiThruSysExState = MIDI_THRU_SYSEX_IDLE;
+      return;
+    }
+    flushMidiThruSysExUsb(true);
+    midiThruStats.streamedSysEx++;
+    midiThruStats.forwarded++;
+    endMidiThruSysExStream();
+    return;
+  }
+  if (state != MIDI_THRU_SYSEX_BUFFER) return;
+  if (!complete) {
+    midiThruStats.droppedSysEx++;
+    return;
+  }
+  for (uint8_t i = 0; i < midiThruSysExLength; i++) midiUartWrite(midiThruSysEx[i]);
+  resetMidiRunningStatus();
+  usbMidiQueueSysEx(midiThruSysEx, midiThruSysExLength);
+  midiThruStats.forwarded++;
+}
+
+/**
+ * Empfangenes Realtime-Byte: DIN hat der RX-ISR schon erledigt, hier nur USB
+ */
+void midiThruRealtime(uint8_t b) {
+  if (!midiThruEnabled) return;
+  usbMidiQueueRealtime(b);
+}
+
+/**
+ * Einmal pro loop(): stockt ein SysEx-Stream (Kabel gezogen), nicht ewig warten
+ */
+void updateMidiThru() {
+  if (midiThruSysExState != MIDI_THRU_SYSEX_STREAM) return;
+  if (millis() - midiThruSysExByteTime < MIDI_THRU_SYSEX_TIMEOUT_MS) return;
+  truncateMidiThruSysEx();
+}
+
+void initMidiThru() {
+  midiInputHandlers.message = midiThruMessage;
+  midiInputHandlers.realtime = midiThruRealtime;
+  midiInputHandlers.sysExByte = midiThruSysExByte;
+  midiInputHandlers.sysExEnd = midiThruSysExEnd;
+  midiUartRealtimeThru = midiThruEnabled;
+}
+
+void setMidiThru(bool enabled) {
+  if (!enabled && midiThruSysExState == MIDI_THRU_SYSEX_STREAM) truncateMidiThruSysEx();
+  midiThruEnabled = enabled;
+  midiUartRealtimeThru = enabled;
+}
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * MIDI UART LAYER (USART1, DIN MIDI 31250 Baud)
+ *
+ * Eigener interrupt-getriebener Treiber statt HardwareSerial (Serial1):
+ * - Zwei Prioritäten beim Senden:
+ *   1. Realtime-Bytes (0xF8/0xFA/0xFB/0xFC) - eigene kleine Queue, gehen immer
+ *      im nächsten freien Byte-Slot raus (MIDI erlaubt sie auch mitten in Messages)
+ *   2. Channel Messages - Ring-Buffer, wird vom UDRE-ISR geleert
+ * - Der Clock-ISR blockiert nie und wartet nie hinter Noten-Bursts
+ * - Empfang per RX-ISR in einen Ring-Buffer (ersetzt Serial1.available/read)
+ * - Empfangene Clock-Bytes (0xF8) bekommen ihren Zeitstempel schon im RX-ISR
+ *   (eigene kleine Queue parallel zum RX-Puffer), unabhängig von der loop()-Latenz
+ * - Soft-Thru für Realtime-Bytes direkt im RX-ISR (midiUartRealtimeThru), alle
+ *   übrigen Messages leitet MidiThru.h an Message-Grenzen weiter
+ * - Messung der Clock-Ausgabe: Verzögerung Timer-ISR -> UDR und Pulsabstand
+ * - Zähler der gesendeten Bytes und Füllstand des TX-Puffers (Bandbreiten-Messung)
+ *
+ * Hinweis: Serial1 darf nirgends mehr benutzt werden, sonst linkt der Arduino-Core
+ * seine eigenen USART1-ISRs dazu (doppelte Vektoren).
+ *
+ * INPUT:
+ *   - midiUartWrite() aus loop() (Noten, CCs)
+ *   - midiUartWriteRealtime() aus ISR oder loop() (Clock, Start/Stop)
+ * OUTPUT:
+ *   - TX Pin (PD3)
+ *   - midiRxBuffer[] - empfangene Bytes (Single-Producer RX ISR / Single-Consumer loop())
+ *   - midiRxClockMicros[] - Empfangszeitpunkt jedes 0xF8 im RX-Puffer
+ *   - midiClockTxStats - Jitter-Statistik der Clock-Ausgabe
+ *   - midiTxByteCount, midiTxPeakDepth - Auslastung der DIN-Leitung
+ */
+
+#ifndef MIDI_UART_H
+#define MIDI_UART_H
+
+#include "arduino_stubs.h"
+#include <avr/interrupt.h>
+
+// ============================================
+// MIDI UART CONFIG
+// ============================================
+
+#define MIDI_UART_BAUD          31250
+#define MIDI_TX_BUFFER_SIZE     64    // Muss eine Zweierpotenz sein
+#define MIDI_RT_BUFFER_SIZE     4     // Muss eine Zweierpotenz sein
+#define MIDI_RX_BUFFER_SIZE     32    // Muss eine Zweierpotenz sein
+#define MIDI_RX_CLOCK_SLOTS     8     // Muss eine Zweierpotenz sein (8 Pulse = 66 ms bei 300 BPM)
+
+#define MIDI_TIMING_CLOCK       0xF8
+
+// ============================================
+// MIDI UART STATE
+// ============================================
+
+volatile uint8_t midiTxBuffer[MIDI_TX_BUFFER_SIZE];
+volatile uint8_t midiTxHead = 0;
+volatile uint8_t midiTxTail = 0;
+
+volatile uint8_t midiRtBuffer[MIDI_RT_BUFFER_SIZE];
+volatile uint8_t midiRtHead = 0;
+volatile uint8_t midiRtTail = 0;
+volatile uint8_t midiRtOverflows = 0;
+
+volatile uint16_t midiTxByteCount = 0;   // Alle gesendeten Bytes (läuft über, Differenzen bilden)
+uint8_t midiTxPeakDepth = 0;             // Höchster Füllstand des Channel-Message Puffers
+
+volatile uint8_t midiRxBuffer[MIDI_RX_BUFFER_SIZE];
+volatile uint8_t midiRxHead = 0;
+volatile uint8_t midiRxTail = 0;
+volatile uint8_t midiRxOverflows = 0;
+
+// Zeitstempel der empfangenen Clock-Bytes, gleiche Reihenfolge wie die 0xF8 im RX-Puffer
+volatile unsigned long midiRxClockMicros[MIDI_RX_CLOCK_SLOTS];
+volatile uint8_t midiRxClockHead = 0;
+volatile uint8_t midiRxClockTail = 0;
+volatile bool midiUartRealtimeThru = false;   // Empfangene Realtime-Bytes sofort weitersenden
+
+// Clock-Ausgabe: Verzögerung (Timer-ISR -> Byte im UDR) und Abweichung des Pulsabstands
+struct MidiClockTxStats {
+  uint16_t count;
+  uint16_t maxDelay;          // µs
+  uint32_t sumDelay;          // µs, Mittelwert = sumDelay / count
+  uint16_t maxIntervalError;  // µs, größte Abweichung vom Soll-Abstand
+};
+volatile MidiClockTxStats midiClockTxStats;
+volatile unsigned long midiClockQueuedMicros = 0;
+volatile unsigned long midiClockSentMicros = 0;
+
+extern unsigned long clockIntervalMicros;
+
+// ============================================
+// MIDI UART FUNCTIONS
+// ============================================
+
+/**
+ * Statistik der Clock-Ausgabe für ein gerade ins UDR geschriebenes 0xF8 (aus dem UDRE ISR)
+ */
+inline void recordMidiClockTx() {
+  unsigned long now = micros();
+  unsigned long delayMicros = now - midiClockQueuedMicros;
+  if (delayMicros > 0xFFFF) delayMicros = 0xFFFF;
+
+  if (midiClockTxStats.count < 0xFFFF) {
+    if (delayMicros > midiClockTxStats.maxDelay) midiClockTxStats.maxDelay = delayMicros;
+    midiClockTxStats.sumDelay += delayMicros;
+    if (midiClockTxStats.count > 0) {
+      unsigned long interval = now - midiClockSentMicros;
+      unsigned long error = (interval > clockIntervalMicros) ? interval - clockIntervalMicros : clockIntervalMicros - interval;
+      if (error > 0xFFFF) error = 0xFFFF;
+      if (error > midiClockTxStats.maxIntervalError) midiClockTxStats.maxIntervalError = error;
+    }
+    midiClockTxStats.count++;
+  }
+  midiClockSentMicros = now;
+}
+
+/**
+ * Datenregister frei: Realtime-Bytes zuerst, dann Channel Messages
+ */
+ISR(USART1_UDRE_vect) {
+  if (midiRtTail != midiRtHead) {
+    uint8_t b = midiRtBuffer[midiRtTail];
+    midiRtTail = (midiRtTail + 1) & (MIDI_RT_BUFFER_SIZE - 1);
+    UDR1 = b;
+    midiTxByteCount++;
+    if (b == MIDI_TIMING_CLOCK) recordMidiClockTx();
+  } else if (midiTxTail != midiTxHead) {
+    UDR1 = midiTxBuffer[midiTxTail];
+    midiTxTail = (midiTxTail + 1) & (MIDI_TX_BUFFER_SIZE - 1);
+    midiTxByteCount++;
+  } else {
+    UCSR1B &= ~(1 << UDRIE1); // Nichts mehr zu senden
+  }
+}
+
+inline void midiUartWriteRealtime(uint8_t b);
+
+/**
+ * Byte empfangen (Fehlerhafte Frames werden verworfen)
+ */
+ISR(USART1_RX_vect) {
+  bool frameError = UCSR1A & (1 << FE1);
+  uint8_t b = UDR1;
+  if (frameError) return;
+
+  // Realtime-Thru ohne Umweg über loop(): Verzögerung höchstens ein Byte
+  if (b >= 0xF8 && midiUartRealtimeThru) midiUartWriteRealtime(b);
+
+  uint8_t next = (midiRxHead + 1) & (MIDI_RX_BUFFER_SIZE - 1);
+  if (next == midiRxTail) {
+    midiRxOverflows++;
+    return;
+  }
+  if (b == MIDI_TIMING_CLOCK) {
+    // Zeitstempel hier statt in loop(): micros() läuft frei auf Timer0 (4 µs Auflösung),
+    // Fehler nur noch die ISR-Latenz. Kein Platz: Byte verwerfen, sonst verrutscht die Zuordnung
+    uint8_t nextClock = (midiRxClockHead + 1) & (MIDI_RX_CLOCK_SLOTS - 1);
+    if (nextClock == midiRxClockTail) {
+      midiRxOverflows++;
+      return;
+    }
+    midiRxClockMicros[midiRxClockHead] = micros();
+    midiRxClockHead = nextClock;
+  }
+  midiRxBuffer[midiRxHead] = b;
+  midiRxHead = next;
+}
+
+/**
+ * Initialisiert USART1: 31250 Baud, 8N1, RX/TX mit Interrupts
+ */
+void initMidiUart() {
+  cli();
+  UBRR1 = (F_CPU / 16 / MIDI_UART_BAUD) - 1;   // 16 MHz -> 31 (exakt)
+  UCSR1A = 0;
+  UCSR1C = (1 << UCSZ11) | (1 << UCSZ10);
+  UCSR1B = (1 << RXEN1) | (1 << TXEN1) | (1 << RXCIE1);
+  midiTxHead = midiTxTail = 0;
+  midiRtHead = midiRtTail = 0;
+  midiRxHead = midiRxTail = 0;
+  midiRxClockHead = midiRxClockTail = 0;
+  sei();
+}
+
+/**
+ * Realtime-Byte mit Vorrang senden. Blockiert nie (ISR-fest);
+ * bei voller Realtime-Queue wird das Byte verworfen und gezählt.
+ */
+inline void midiUartWriteRealtime(uint8_t b) {
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t next = (midiRtHead + 1) & (MIDI_RT_BUFFER_SIZE - 1);
+  if (next == midiRtTail) {
+    midiRtOverflows++;
+  } else {
+    midiRtBuffer[midiRtHead] = b;
+    midiRtHead = next;
+    if (b == MIDI_TIMING_CLOCK) midiClockQueuedMicros = micros();
+    UCSR1B |= (1 << UDRIE1);
+  }
+  SREG = sreg;
+}
+
+/**
+ * Channel-Message Byte in den Ring-Buffer. Nur aus loop() aufrufen:
+ * Bei vollem Puffer wird gewartet, bis der UDRE ISR Platz gemacht hat.
+ */
+void midiUartWrite(uint8_t b) {
+  uint8_t next = (midiTxHead + 1) & (MIDI_TX_BUFFER_SIZE - 1);
+  while (next == midiTxTail) {
+    // Puffer voll: ISR leert ihn (Interrupts sind in loop() aktiv)
+  }
+  midiTxBuffer[midiTxHead] = b;
+  midiTxHead = next;
+  uint8_t depth = (midiTxHead - midiTxTail) & (MIDI_TX_BUFFER_SIZE - 1);
+  if (depth > midiTxPeakDepth) midiTxPeakDepth = depth;
+  uint8_t sreg = SREG;
+  cli();
+  UCSR1B |= (1 << UDRIE1);
+  SREG = sreg;
+}
+
+/**
+ * Freier Platz im Channel-Message Puffer (Bytes)
+ */
+inline uint8_t midiUartTxFree() {
+  return (midiTxTail - midiTxHead - 1) & (MIDI_TX_BUFFER_SIZE - 1);
+}
+
+/**
+ * Bytes, die im Channel-Message Puffer noch auf das Senden warten
+ */
+inline uint8_t midiUartTxPending() {
+  return (midiTxHead - midiTxTail) & (MIDI_TX_BUFFER_SIZE - 1);
+}
+
+/**
+ * Seit dem Start gesendete Bytes (16 Bit, läuft über)
+ */
+inline uint16_t midiUartTxByteCount() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = midiTxByteCount;
+  SREG = sreg;
+  return count;
+}
+
+inline bool midiUartAvailable() {
+  return midiRxTail != midiRxHead;
+}
+
+inline uint8_t midiUartRead() {
+  uint8_t b = midiRxBuffer[midiRxTail];
+  midiRxTail = (midiRxTail + 1) & (MIDI_RX_BUFFER_SIZE - 1);
+  return b;
+}
+
+/**
+ * Empfangszeitpunkt des zuletzt gelesenen 0xF8 (einmal pro Clock-Byte aufrufen)
+ */
+inline unsigned long midiUartReadClockMicros() {
+  if (midiRxClockTail == midiRxClockHead) return micros();   // Sollte nie passieren
+  unsigned long t = midiRxClockMicros[midiRxClockTail];
+  midiRxClockTail = (midiRxClockTail + 1) & (MIDI_RX_CLOCK_SLOTS - 1);
+  return t;
+}
+
+void resetMidiClockTxStats() {
+  cli();
+  midiClockTxStats.count = 0;
+  midiClockTxStats.maxDelay = 0;
+  midiClockTxStats.sumDelay = 0;
+  midiClockTxStats.maxIntervalError = 0;
+  sei();
+}
+
+#endif
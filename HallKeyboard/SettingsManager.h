@@ -26,6 +26,17 @@ struct KeyboardSettings {
   uint8_t arpeggiatorDutyCycle;
 };
 
+// Per-Key Kalibrierung der analogen Hall-Keys (hinter KeyboardSettings)
+#define KEY_CALIBRATION_MAGIC 0x4B43 // "KC"
+#define KEY_CALIBRATION_EEPROM_ADDR 32
+
+struct KeyCalibrationData {
+  uint16_t magic;
+  uint8_t actuationDepth;
+  uint8_t rest[NUM_ANALOG_CAPABLE_SLOTS];    // Rohwert >> 2
+  uint8_t bottom[NUM_ANALOG_CAPABLE_SLOTS];  // Rohwert >> 2
+};
+
 // Forward Declarations der globalen Variablen (definiert in den jeweiligen Layer-Files)
 extern uint8_t playModeType;
 extern int8_t currentOctave;
@@ -36,6 +47,9 @@ extern int8_t diatonicRootKey;
 extern int8_t arpeggiatorMode;
 extern uint8_t arpeggiatorRate;
 extern uint8_t arpeggiatorDutyCycle;
+extern uint8_t keyCalRest[NUM_ANALOG_CAPABLE_SLOTS];
+extern uint8_t keyCalBottom[NUM_ANALOG_CAPABLE_SLOTS];
+extern uint8_t analogActuationDepth;
 
 /**
  * Speichert die aktuellen globalen Variablen ins EEPROM
@@ -82,4 +96,35 @@ void loadSettingsFromEEPROM() {
   }
 }
 
+/**
+ * Speichert Kalibrierung und Auslösepunkt der analogen Keys ins EEPROM
+ */
+void saveKeyCalibrationToEEPROM() {
+  KeyCalibrationData cal;
+  cal.magic = KEY_CALIBRATION_MAGIC;
+  cal.actuationDepth = analogActuationDepth;
+  for (int i = 0; i < NUM_ANALOG_CAPABLE_SLOTS; i++) {
+    cal.rest[i] = keyCalRest[i];
+    cal.bottom[i] = keyCalBottom[i];
+  }
+  EEPROM.put(KEY_CALIBRATION_EEPROM_ADDR, cal);
+}
+
+/**
+ * Lädt Kalibrierung und Auslösepunkt und rechnet die Schwellen neu
+ */
+void loadKeyCalibrationFromEEPROM() {
+  KeyCalibrationData cal;
+  EEPROM.get(KEY_CALIBRATION_EEPROM_ADDR, cal);
+
+  if (cal.magic == KEY_CALIBRATION_MAGIC) {
+    analogActuationDepth = cal.actuationDepth;
+    for (int i = 0; i < NUM_ANALOG_CAPABLE_SLOTS; i++) {
+      keyCalRest[i] = cal.rest[i];
+      keyCalBottom[i] = cal.bottom[i];
+    }
+  }
+  computeAnalogKeyThresholds();
+}
+
 #endif
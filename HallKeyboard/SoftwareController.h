@@ -8,11 +8,13 @@
  * - Verarbeitet Function Switch Events
  * 
  * INPUT: 
- *   - switch_triggered[], switch_released[], switch_held[] vom Hardware Controller
+ *   - keyPressedMask, keyReleasedMask, keyHeldMask vom Hardware Controller
+ *   - Tastendruck der analogen Keys (Polyphonic Aftertouch)
  *   - Tap Tempo Events
  * 
  * OUTPUT:
  *   - State Variablen die andere Layer nutzen
+ *   - Note Events (Layer KEYS/HOLD/CHORD/BASS) auf dem MIDI Event Bus
  *   - Beschreibt welche Modi aktiv sind und wie sie zusammenwirken
  */
 
@@ -21,6 +23,7 @@
 
 #include "HardwareController.h"
 #include "ArduinoTapTempo.h"
+#include "MidiEventBus.h"
 
 void saveSettingsToEEPROM(); // Forward Declaration
 
@@ -83,6 +86,18 @@ int8_t heldSwitchIdx = -1;
 bool heldNotes[NUM_SWITCHES];
 uint8_t activeSwitchNotes[NUM_SWITCHES][5];
 uint8_t activeSwitchNumNotes[NUM_SWITCHES];
+uint8_t activeSwitchNoteRoutes[NUM_SWITCHES][5];   // MIDI_NOTE_ROUTE beim Note On: Layer + Kanal für das Note Off
+
+// Polyphonic Aftertouch pro Switch: zuletzt gesendeter Wert + Zeitpunkt (ms, 16 Bit)
+#define AFTERTOUCH_CHANGE_THRESHOLD 3
+#define AFTERTOUCH_MIN_INTERVAL_MS  15
+uint8_t switchAftertouch[NUM_SWITCHES];
+uint16_t switchAftertouchTime[NUM_SWITCHES];
+uint8_t aftertouchNextSwitch = 0;   // Round Robin, damit das Budget fair verteilt wird
+
+// Zeitstempel des gerade verarbeiteten Tasten-Events (micros, 0 = kein Tasten-Event,
+// z.B. Arp-Step). Arpeggiator und MIDI Generator lesen ihn für Quantisierung/Latenz.
+unsigned long noteEventMicros = 0;
 
 // Chord Mode Variables
 extern int8_t chordModeType;
@@ -103,9 +118,6 @@ bool savedPlayModeActiveBeforeArp = false;
 extern void resetArpeggiatorPhase();
 extern bool arpWaitingForSync;
 
-// New: Reference counting for overlapping chords in Additive Hold
-uint8_t holdModeNoteRefCount[128];
-
 // Save/Restore Variables
 int8_t savedArpeggiatorModeBeforeSubmenu = 0;
 uint8_t savedArpeggiatorRateBeforeSubmenu = 2; // Default RATE_EIGHTH
@@ -121,23 +133,20 @@ bool savedArpeggiatorActiveBeforeSubmenu = false;
 extern int8_t currentOctave;
 extern ArduinoTapTempo tapTempo;
 extern volatile bool midiClockActive;
-extern uint16_t calculatedBPM;
+extern bool midiClockStopped;
+extern unsigned long getMidiClockPeriodMicros();
 extern void syncMidiClockPhase();
 extern void syncMidiClockToBPM();
 extern uint8_t bpmPriorityBeats;
-extern void sendMidiNote(int cmd, int pitch, int velocity);
+extern bool sendMidiPolyPressure(int pitch, int pressure);
 extern void setLED(int switchIndex, bool on, bool skipLEDs = false);
 extern void confirmLED(int switchIndex);
 extern void disableControllerLEDsForNotes();
-extern bool switch_triggered[13];
-extern bool switch_released[13];
-extern bool switch_held[13];
 extern int getChordNote(int switchIndex, int variationType, int noteIndex);
 extern void removeNoteFromArpeggiatorMode(int note);
 extern void addNoteToArpeggiatorMode(int note);
 extern void clearArpeggiatorNotes();
 extern void transposeArpeggiatorNotes(int semiTones);
-extern uint8_t arpNoteRefCount[128];
 extern void clearChordMode();
 extern const uint8_t maxChordNotes;
 extern uint8_t holdModeMidiNotes[16];
@@ -176,9 +185,7 @@ void initSoftwareController() {
     heldNotes[i] = false;
     chordNotesActive[i] = false;
     activeSwitchNumNotes[i] = 0;
-  }
-  for (int i = 0; i < 128; i++) {
-    holdModeNoteRefCount[i] = 0;
+    switchAftertouch[i] = 0;
   }
 }
 
@@ -196,9 +203,8 @@ void deactivatePlayMode() {
 
   // Wenn Play Mode aus, alle gehaltenen Noten sofort beenden
   for (int i = 0; i < 128; i++) {
-    holdModeNoteRefCount[i] = 0;
     if (IS_HOLD_NOTE_ACTIVE(i)) {
-      sendMidiNote(0x90, i, 0x00);
+      postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, i));
       SET_HOLD_NOTE_ACTIVE(i, false);
       // BUG FIX: Wenn Hold deaktiviert wird, Noten auch aus Arp entfernen (falls sie nicht physikalisch gehalten werden)
       removeNoteFromArpeggiatorMode(i);
@@ -280,9 +286,8 @@ void toggleChordModeOnOff() {
     // Wenn Chord Mode aus, beende alle per Akkord gehaltenen Noten
     // Um sicher zu gehen, beenden wir alle gehaltenen Noten im Hold Mode
     for (int i = 0; i < 128; i++) {
-       holdModeNoteRefCount[i] = 0;
        if (IS_HOLD_NOTE_ACTIVE(i)) {
-         sendMidiNote(0x90, i, 0x00);
+         postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, i));
          SET_HOLD_NOTE_ACTIVE(i, false);
          // Auch aus Arp entfernen
          removeNoteFromArpeggiatorMode(i);
@@ -319,6 +324,7 @@ void toggleArpeggiatorOnOff() {
     
     // Nur MIDI START/Phase Reset senden, wenn wir MASTER sind (keine externe Clock)
     if (!midiClockActive) {
+      midiClockStopped = false;   // Wieder Master: ein früheres MIDI Stop gilt nicht mehr
       startMidiClock();
       tapTempo.resetTapChain(); // Setzt Master-Beat auf "jetzt"
       resetArpeggiatorPhase();  // Setzt Arp-Trigger-Logik zurück
@@ -328,14 +334,14 @@ void toggleArpeggiatorOnOff() {
     if (holdMode) {
       for (int i = 0; i < 128; i++) {
         if (IS_HOLD_NOTE_ACTIVE(i)) {
-          sendMidiNote(0x90, i, 0x00);
+          postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, i));
         }
       }
     }
     
     // 2. Bestehende gehaltene Noten (aus manuellem Hold) in den Arpeggiator übertragen
     for (int i = 0; i < NUM_SWITCHES; i++) {
-        if (heldNotes[i] || switch_held[i]) {
+        if (heldNotes[i] || IS_SWITCH_HELD(i)) {
             // Berechne Noten (inkl. Chords)
             int baseNote = pgm_read_byte(&midiNotes[i]) + (currentOctave * 12);
             if (chordModeActive && chordModeType != CHORD_MODE_OFF) {
@@ -405,11 +411,10 @@ void toggleArpeggiatorOnOff() {
         heldNotes[i] = false;
         setLED(i, false);
       }
-      // Auch alle gehaltenen Noten stoppen und RefCounts zurücksetzen
+      // Auch alle gehaltenen Noten stoppen (alle Besitzer freigeben)
       for (int i = 0; i < 128; i++) {
-        holdModeNoteRefCount[i] = 0;
         if (IS_HOLD_NOTE_ACTIVE(i)) {
-          sendMidiNote(0x90, i, 0x00);
+          postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, i));
           SET_HOLD_NOTE_ACTIVE(i, false);
         }
       }
@@ -669,8 +674,8 @@ void handleShortPress(int fsNumber) {
           // Wir kompensieren die Zeit, die der User den Knopf gehalten hat.
           unsigned long deltaMicros = micros() - functionSwitchPressMicros[3];
           
-          // Dauer eines einzelnen MIDI-Pulses in Mikrosekunden
-          float pulseLenMicros = (60000000.0 / (float)calculatedBPM) / 24.0;
+          // Dauer eines einzelnen MIDI-Pulses in Mikrosekunden (geglättet aus der Clock-PLL)
+          unsigned long pulseLenMicros = getMidiClockPeriodMicros();
           
           // Berechne wie viele Pulse seit dem Niederdrücken vergangen sind
           uint16_t pulsesSinceDown = (uint16_t)(deltaMicros / pulseLenMicros);
@@ -695,66 +700,217 @@ void handleShortPress(int fsNumber) {
   }
 }
 
+// ============================================
+// FUNCTION SWITCH GESTURES
+// ============================================
+
+// Welche Gesten hat ein Function Switch im Hauptmenü?
+#define FS_GESTURE_HAS_LONG    0x01
+#define FS_GESTURE_HAS_DOUBLE  0x02
+
+const uint8_t functionSwitchGestureFlags[NUM_FUNCTION_SWITCHES] PROGMEM = {
+  FS_GESTURE_HAS_LONG | FS_GESTURE_HAS_DOUBLE,  // FS1: Play Mode / Submenu 1 bzw. Arp löschen / Double-Tap: Hold löschen
+  FS_GESTURE_HAS_LONG,                          // FS2: Chord Mode / Submenu 2
+  FS_GESTURE_HAS_LONG,                          // FS3: Arpeggiator / Submenu 3
+  FS_GESTURE_HAS_LONG                           // FS4: Downbeat Sync / Submenu 4
+};
+
+// Zustand vor einer sofort ausgeführten Short-Action (Bit-gepackt, siehe captureShortPressState)
+uint8_t functionSwitchRollback[NUM_FUNCTION_SWITCHES];
+#define FS_NO_ROLLBACK 0xFF
+
+uint8_t getFunctionSwitchGestureFlags(int i) {
+  if (inSubmenu) {
+    // Im Submenü hat nur FS4 eine Long-Press Aktion (Seite umblättern)
+    return (i == 3) ? FS_GESTURE_HAS_LONG : 0;
+  }
+  return pgm_read_byte(&functionSwitchGestureFlags[i]);
+}
+
+/**
+ * Ändert die Short-Action dieses Switches nur Modus-Flags (keine MIDI-Ausgabe, kein
+ * Löschen von Noten)? Nur dann wird sie beim Press ausgeführt und kann per Long Press
+ * zurückgenommen werden, solange dazwischen keine Taste gespielt wurde (siehe
+ * handleFunctionSwitches()). Die Anzeige springt wie bei jedem FS-Druck auf den Control Layer.
+ */
+bool isShortPressReversible(int fsNumber) {
+  if (inSubmenu) return false;
+  switch (fsNumber) {
+    case 1: return !(playModeActive && (playModeType == PLAY_MODE_TOGGLE_OFF_HOLD || playModeType == PLAY_MODE_TOGGLE_OFF_ADDITIVE));
+    case 2: return !chordModeActive;
+    default: return false;
+  }
+}
+
+uint8_t captureShortPressState(int fsNumber) {
+  switch (fsNumber) {
+    case 1: return (playModeActive ? 0x01 : 0) | (holdMode ? 0x02 : 0) | (additiveMode ? 0x04 : 0) | (autoHoldActivatedByArp ? 0x08 : 0);
+    case 2: return (chordModeActive ? 0x01 : 0) | ((chordModeType & 0x0F) << 4);
+    default: return FS_NO_ROLLBACK;
+  }
+}
+
+void rollbackShortPress(int fsNumber, uint8_t state) {
+  if (state == FS_NO_ROLLBACK) return;
+  switch (fsNumber) {
+    case 1:
+      playModeActive = state & 0x01;
+      holdMode = state & 0x02;
+      additiveMode = state & 0x04;
+      autoHoldActivatedByArp = state & 0x08;
+      break;
+    case 2:
+      chordModeActive = state & 0x01;
+      chordModeType = state >> 4;
+      break;
+  }
+}
+
+/**
+ * Hält ein (per Hold gehaltener) Switch diese Note noch?
+ * Ersetzt den RefCount pro Tonhöhe: abgeleitet aus activeSwitchNotes[]
+ */
+bool isNoteHeldBySwitch(int note) {
+  for (int s = 0; s < NUM_SWITCHES; s++) {
+    if (!heldNotes[s]) continue;
+    for (int n = 0; n < activeSwitchNumNotes[s]; n++) {
+      if (activeSwitchNotes[s][n] == note) return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Alle per Hold gehaltenen Noten freigeben (im Arp-Modus auch den Arp-Speicher)
+ */
+void releaseLatchedNotes() {
+  if (arpeggiatorActive) clearArpeggiatorNotes();
+  
+  for (int n = 0; n < 128; n++) {
+    if (IS_HOLD_NOTE_ACTIVE(n)) {
+      if (!arpeggiatorActive) postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, n));
+      SET_HOLD_NOTE_ACTIVE(n, false);
+    }
+  }
+  for (int s = 0; s < NUM_SWITCHES; s++) {
+    if (heldNotes[s]) {
+      heldNotes[s] = false;
+      if (!IS_SWITCH_HELD(s)) {
+        activeSwitchNumNotes[s] = 0;
+        setLED(s, false);
+      }
+    }
+  }
+  heldNote = -1;
+  heldSwitchIdx = -1;
+}
+
+// Long-Press Handler
+void handleLongPress(int fsNumber) {
+  if (inSubmenu) {
+    // Innerhalb eines Submenüs: FS4 blättert Seiten um
+    if (fsNumber == 4) {
+      int numPages = 1; // Default: 1 Seite (0)
+      if (currentSubmenu == 2) numPages = 3;
+      if (currentSubmenu == 3) numPages = 3;
+      
+      currentSubmenuPage = (currentSubmenuPage + 1) % numPages;
+      enterSubmenuPage(currentSubmenu, currentSubmenuPage);
+    }
+  } else if (fsNumber == 1 && arpeggiatorActive) {
+    // SPECIAL: Long Press on Hold (FS1) in ARP Mode clears ARP memory
+    releaseLatchedNotes();
+    confirmLED(0); // Visuelles Feedback
+  } else {
+    enterSubmenu(fsNumber);
+  }
+}
+
+// Double-Tap Handler
+void handleDoubleTap(int fsNumber) {
+  lastNoteActiveTime = 0;
+  if (fsNumber == 1) {
+    // FS1 Double-Tap: Hold-Speicher leeren, Play Mode bleibt wie er war
+    releaseLatchedNotes();
+    confirmLED(0);
+  }
+}
+
 /**
- * Verarbeite Function Switch Events
+ * Verarbeite Function Switch Events (Gesten-Automat pro Switch)
+ * - Reversible Short-Actions werden sofort beim Press ausgeführt und bei einem
+ *   Long Press zurückgenommen; alle anderen wie bisher beim Release
+ * - Short-Actions ohne konkurrierende Long-Press Aktion laufen immer sofort
+ * - Zweiter Press innerhalb DOUBLE_TAP_WINDOW nimmt den ersten Tap zurück
+ *   (falls möglich) und löst die Double-Tap Aktion aus
+ * - Wird eine Taste gespielt, während eine Short-Action noch zurückgenommen werden
+ *   könnte, gilt sie endgültig: die Noten klingen schon im neuen Modus (Hold-Speicher,
+ *   Akkord-Stimmen), ein Rollback der Flags ließe sie verwaist stehen
  */
 void handleFunctionSwitches() {
+  unsigned long now = millis();
+  bool notesTriggered = (keyPressedMask & ~FUNCTION_SWITCH_SCAN_MASK) != 0;
+  
   for (int i = 0; i < NUM_FUNCTION_SWITCHES; i++) {
-    if (functionSwitches[i].trigger()) {
-      functionSwitchPressTime[i] = millis();
-      functionSwitchPressMicros[i] = micros();
-      functionSwitchLongPressed[i] = false;
+    uint8_t state = functionSwitchGesture[i];
+    uint8_t flags = getFunctionSwitchGestureFlags(i);
+    
+    if (state == FS_GESTURE_TAPPED && now - functionSwitchPressTime[i] >= DOUBLE_TAP_WINDOW) {
+      state = FS_GESTURE_IDLE;
     }
     
-    if (functionSwitches[i].isDown() && !functionSwitchLongPressed[i]) {
-      unsigned long currentPressTime = millis() - functionSwitchPressTime[i];
-      if (currentPressTime >= LONG_PRESS_DURATION) {
-        functionSwitchLongPressed[i] = true;
-        
-        if (inSubmenu) {
-          // Innerhalb eines Submenüs: FS4 (Index 3) blättert Seiten um
-          if (i == 3) {
-            int numPages = 1; // Default: 1 Seite (0)
-            if (currentSubmenu == 2) numPages = 3;
-            if (currentSubmenu == 3) numPages = 3;
-            
-            currentSubmenuPage = (currentSubmenuPage + 1) % numPages;
-            enterSubmenuPage(currentSubmenu, currentSubmenuPage);
-            //Serial.print("Submenu Page gewechselt zu: ");
-            //Serial.println(currentSubmenuPage);
-          }
-        } else {
-          // SPECIAL: Long Press on Hold (FS1) in ARP Mode clears ARP memory
-          if (i == 0 && arpeggiatorActive) {
-            clearArpeggiatorNotes();
-            
-            // Auch Hold-Noten im Speicher löschen (damit der Arp wirklich leer ist)
-            for (int n = 0; n < 128; n++) {
-              holdModeNoteRefCount[n] = 0;
-              if (IS_HOLD_NOTE_ACTIVE(n)) {
-                SET_HOLD_NOTE_ACTIVE(n, false);
-              }
-            }
-            for (int s = 0; s < NUM_SWITCHES; s++) {
-               heldNotes[s] = false;
-            }
-            heldNote = -1;
-            heldSwitchIdx = -1;
-
-            confirmLED(0); // Visuelles Feedback
-          } else {
-            enterSubmenu(i + 1);
-          }
-        }
+    if (IS_FS_TRIGGERED(i)) {
+      // functionSwitchPressMicros[] kommt bereits mit Zeitstempel aus dem Scan-ISR
+      if (state == FS_GESTURE_TAPPED && (flags & FS_GESTURE_HAS_DOUBLE)) {
+        rollbackShortPress(i + 1, functionSwitchRollback[i]);
+        handleDoubleTap(i + 1);
+        state = FS_GESTURE_DONE;
+      } else if (!(flags & FS_GESTURE_HAS_LONG)) {
+        // Keine Long-Press Aktion: nichts abzuwarten
+        handleShortPress(i + 1);
+        state = FS_GESTURE_DONE;
+      } else if (isShortPressReversible(i + 1)) {
+        functionSwitchRollback[i] = captureShortPressState(i + 1);
+        handleShortPress(i + 1);
+        state = FS_GESTURE_COMMITTED;
+      } else {
+        state = FS_GESTURE_PRESSED;
       }
+      functionSwitchPressTime[i] = now;
     }
     
-    if (functionSwitches[i].released()) {
-      if (!functionSwitchLongPressed[i]) {
+    // Taste gespielt (auch im selben Durchlauf wie der Press): kein Long Press /
+    // Double-Tap mehr, der die Short-Action zurücknimmt
+    if (notesTriggered) {
+      if (state == FS_GESTURE_COMMITTED) state = FS_GESTURE_DONE;
+      else if (state == FS_GESTURE_TAPPED) state = FS_GESTURE_IDLE;
+    }
+    
+    if ((state == FS_GESTURE_PRESSED || state == FS_GESTURE_COMMITTED) &&
+        IS_FS_HELD(i) && now - functionSwitchPressTime[i] >= LONG_PRESS_DURATION) {
+      if (state == FS_GESTURE_COMMITTED) {
+        rollbackShortPress(i + 1, functionSwitchRollback[i]);
+      }
+      handleLongPress(i + 1);
+      state = FS_GESTURE_DONE;
+    }
+    
+    if (IS_FS_RELEASED(i)) {
+      if (state == FS_GESTURE_PRESSED) {
+        functionSwitchRollback[i] = FS_NO_ROLLBACK;
         handleShortPress(i + 1);
+        state = FS_GESTURE_COMMITTED;
+      }
+      if (state == FS_GESTURE_COMMITTED && (flags & FS_GESTURE_HAS_DOUBLE)) {
+        // Ab jetzt misst functionSwitchPressTime das Double-Tap Fenster
+        functionSwitchPressTime[i] = now;
+        state = FS_GESTURE_TAPPED;
+      } else if (state != FS_GESTURE_TAPPED) {
+        state = FS_GESTURE_IDLE;
       }
-      functionSwitchLongPressed[i] = false;
     }
+    
+    functionSwitchGesture[i] = state;
   }
 }
 
@@ -771,16 +927,21 @@ void updateSoftwareController() {
 void processNoteSwitches() {
   for (int i = 0; i < NUM_SWITCHES; i++) {
     int currentNote = getHardwareMIDINote(i);
+    uint8_t velocity = switchVelocity[i];
+    noteEventMicros = (IS_SWITCH_TRIGGERED(i) || IS_SWITCH_RELEASED(i)) ? switchEventMicros[i] : 0;
     
-    if (switch_triggered[i]) {
+    if (IS_SWITCH_TRIGGERED(i)) {
+      switchAftertouch[i] = 0;
+      
       // Submenu handling
       if (inSubmenu) {
         // Beim Oktave-Wechsel (Submenu 4) Noten normal weiterspielen lassen!
         if (currentSubmenu == 4) {
           // Keine spezielle Sperre für Arpeggiator oder Hold hier
         } else if (currentSubmenu == 1 || currentSubmenu == 3) {
-          sendMidiNote(0x90, currentNote, 0x45);
+          postMidiEvent(midiNoteOnEvent(MIDI_LAYER_KEYS, currentNote, velocity));
           activeSwitchNotes[i][0] = currentNote;
+          activeSwitchNoteRoutes[i][0] = MIDI_NOTE_ROUTE(MIDI_LAYER_KEYS);
           activeSwitchNumNotes[i] = 1;
           continue;
         } else if (currentSubmenu == 2) {
@@ -866,9 +1027,8 @@ void processNoteSwitches() {
             heldNotes[heldSwitchIdx] = false;
             activeSwitchNumNotes[heldSwitchIdx] = 0; 
             for (int n = 0; n < 128; n++) {
-              holdModeNoteRefCount[n] = 0;
               if (IS_HOLD_NOTE_ACTIVE(n)) {
-                if (!arpeggiatorActive) sendMidiNote(0x90, n, 0x00);
+                if (!arpeggiatorActive) postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, n));
                 SET_HOLD_NOTE_ACTIVE(n, false);
                 removeNoteFromArpeggiatorMode(n);
               }
@@ -878,7 +1038,7 @@ void processNoteSwitches() {
           heldNotes[i] = true;
           isTriggeringNew = true;
           
-          // Speichern für Single Hold (auch wenn wir hier den RefCount-Quickfix oben haben)
+          // Speichern für Single Hold
           activeSwitchNumNotes[i] = numNotesToPlay;
           for (int n = 0; n < numNotesToPlay; n++) {
             activeSwitchNotes[i][n] = notesToPlay[n];
@@ -896,9 +1056,8 @@ void processNoteSwitches() {
           activeSwitchNumNotes[i] = 0;
 
           for (int n = 0; n < 128; n++) {
-            holdModeNoteRefCount[n] = 0;
             if (IS_HOLD_NOTE_ACTIVE(n)) {
-              if (!arpeggiatorActive) sendMidiNote(0x90, n, 0x00);
+              if (!arpeggiatorActive) postMidiEvent(midiNoteOffAllEvent(MIDI_LAYER_HOLD, n));
               SET_HOLD_NOTE_ACTIVE(n, false);
               removeNoteFromArpeggiatorMode(n);
             }
@@ -914,45 +1073,40 @@ void processNoteSwitches() {
         }
       }
       
-      // Play notes
+      // Play notes (Kanal je nach Layer, Akkord-Grundton = notesToPlay[0])
+      bool isChord = chordModeActive && chordModeType != CHORD_MODE_OFF;
       for (int noteIdx = 0; noteIdx < numNotesToPlay; noteIdx++) {
         int noteToPlay = notesToPlay[noteIdx];
+        uint8_t noteLayer = getKeyNoteLayer(isChord, noteIdx == 0, holdMode);
+        // Einschalten: Layer + Kanal merken; Ausschalten: mit dem gemerkten Layer und Kanal
+        if (isTriggeringNew) activeSwitchNoteRoutes[i][noteIdx] = MIDI_NOTE_ROUTE(noteLayer);
+        uint8_t noteRoute = activeSwitchNoteRoutes[i][noteIdx];
         if (holdMode) {
           if (additiveMode) {
             if (isTriggeringNew) {
               // Additive Hold: Turning switch ON
-              if (!IS_HOLD_NOTE_ACTIVE(noteToPlay)) {
-                SET_HOLD_NOTE_ACTIVE(noteToPlay, true);
-                if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x45);
-              }
-              if (holdModeNoteRefCount[noteToPlay] < 255) {
-                holdModeNoteRefCount[noteToPlay]++;
-              }
+              // (Gemeinsame Akkordtöne zählt der Voice Allocator, Note On nur beim ersten)
+              SET_HOLD_NOTE_ACTIVE(noteToPlay, true);
+              if (!arpeggiatorActive) postMidiEvent(midiNoteOnEvent(noteLayer, noteToPlay, velocity));
               addNoteToArpeggiatorMode(noteToPlay);
             } else {
-              // Additive Hold: Turning switch OFF
-              if (holdModeNoteRefCount[noteToPlay] > 0) {
-                holdModeNoteRefCount[noteToPlay]--;
-                if (holdModeNoteRefCount[noteToPlay] == 0) {
-                  SET_HOLD_NOTE_ACTIVE(noteToPlay, false);
-                  if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x00);
-                }
+              // Additive Hold: Turning switch OFF (Note Off erst beim letzten Besitzer)
+              if (!isNoteHeldBySwitch(noteToPlay)) {
+                SET_HOLD_NOTE_ACTIVE(noteToPlay, false);
               }
+              if (!arpeggiatorActive) postMidiEvent(midiNoteOffEventForRoute(noteRoute, noteToPlay));
               removeNoteFromArpeggiatorMode(noteToPlay);
             }
           } else {
             // Single Hold: Note aktivieren (Alte wurden oben bereits deaktiviert)
             if (isTriggeringNew) {
               SET_HOLD_NOTE_ACTIVE(noteToPlay, true);
-              if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x45);
-              // RefCounts wurden oben beim loeschen der alten Noten bereits zurueckgesetzt
-              holdModeNoteRefCount[noteToPlay] = 1;
+              if (!arpeggiatorActive) postMidiEvent(midiNoteOnEvent(noteLayer, noteToPlay, velocity));
               addNoteToArpeggiatorMode(noteToPlay);
             } else {
               // Single Hold Ausschalten (Gleiche Taste nochmal)
               SET_HOLD_NOTE_ACTIVE(noteToPlay, false);
-              if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x00);
-              holdModeNoteRefCount[noteToPlay] = 0;
+              if (!arpeggiatorActive) postMidiEvent(midiNoteOffEventForRoute(noteRoute, noteToPlay));
               removeNoteFromArpeggiatorMode(noteToPlay);
             }
           }
@@ -961,12 +1115,12 @@ void processNoteSwitches() {
           // Falls Arp aus ist, spielen wir die Note statisch
           if (isTriggeringNew) {
             addNoteToArpeggiatorMode(noteToPlay);
-            if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x45);
+            if (!arpeggiatorActive) postMidiEvent(midiNoteOnEvent(noteLayer, noteToPlay, velocity));
           } else {
             // Dieser Pfad wird bei momentary triggered normal nicht erreicht,
             // aber zur Sicherheit fuer konsistente Logik:
             removeNoteFromArpeggiatorMode(noteToPlay);
-            if (!arpeggiatorActive) sendMidiNote(0x90, noteToPlay, 0x00);
+            if (!arpeggiatorActive) postMidiEvent(midiNoteOffEventForRoute(noteRoute, noteToPlay));
           }
         }
       }
@@ -976,22 +1130,24 @@ void processNoteSwitches() {
       }
     }
     
-    if (switch_released[i]) {
+    if (IS_SWITCH_RELEASED(i)) {
       if (inSubmenu && (currentSubmenu == 1 || currentSubmenu == 3 || currentSubmenu == 4)) {
         // Beim Oktave-Wechsel oder Arp-Menue muessen wir auch die korrekt gespeicherten Noten stoppen
         if (!holdMode || !heldNotes[i]) {
           int numNotesToRelease = activeSwitchNumNotes[i];
           for (int n = 0; n < numNotesToRelease; n++) {
-            sendMidiNote(0x90, activeSwitchNotes[i][n], 0x00);
+            postMidiEvent(midiNoteOffEventForRoute(activeSwitchNoteRoutes[i][n], activeSwitchNotes[i][n]));
           }
           activeSwitchNumNotes[i] = 0;
         }
       } else {
         int notesToRelease[5];
+        uint8_t routesToRelease[5];
         int numNotesToRelease = activeSwitchNumNotes[i]; // Nutze gespeicherte Noten
         
         for (int n = 0; n < numNotesToRelease; n++) {
           notesToRelease[n] = activeSwitchNotes[i][n];
+          routesToRelease[n] = activeSwitchNoteRoutes[i][n];
         }
         
         // WICHTIG: Speicher nur leeren, wenn HOLD inaktiv oder Note gerade per Toggle ausgeschaltet wurde
@@ -1002,10 +1158,10 @@ void processNoteSwitches() {
         for (int noteIdx = 0; noteIdx < numNotesToRelease; noteIdx++) {
           int noteToRelease = notesToRelease[noteIdx];
           // Wir entfernen die Note IMMER aus dem Arpeggiator (sofern kein Hold aktiv ist)
-          // Die Arp-Logik selbst enthaelt den RefCount
+          // Doppelte Tonhöhen zählen Arp-Liste und Voice Allocator
           if (!holdMode) {
             removeNoteFromArpeggiatorMode(noteToRelease);
-            if (!arpeggiatorActive) sendMidiNote(0x90, noteToRelease, 0x00);
+            if (!arpeggiatorActive) postMidiEvent(midiNoteOffEventForRoute(routesToRelease[noteIdx], noteToRelease));
           }
         }
         
@@ -1022,6 +1178,41 @@ void processNoteSwitches() {
       }
     }
   }
+  noteEventMicros = 0;
+}
+
+/**
+ * Polyphonic Aftertouch für gehaltene analoge Keys
+ * Pro Switch: Senden nur bei Änderung >= Schwelle und nach Mindestabstand.
+ * Global: MidiGenerator begrenzt die Bandbreite, Rest folgt im nächsten Frame.
+ */
+void processAftertouch() {
+  if (analogSwitchMask == 0) return;
+  
+  uint16_t now = (uint16_t)millis();
+  for (int k = 0; k < NUM_SWITCHES; k++) {
+    int i = aftertouchNextSwitch + k;
+    if (i >= NUM_SWITCHES) i -= NUM_SWITCHES;
+    if (!(analogSwitchMask & (1 << i)) || !IS_SWITCH_HELD(i)) continue;
+    if (activeSwitchNumNotes[i] == 0) continue;
+    
+    uint8_t pressure = getAnalogKeyPressure(i);
+    uint8_t last = switchAftertouch[i];
+    uint8_t delta = (pressure > last) ? pressure - last : last - pressure;
+    if (delta < AFTERTOUCH_CHANGE_THRESHOLD && !(pressure == 0 && last != 0)) continue;
+    if ((uint16_t)(now - switchAftertouchTime[i]) < AFTERTOUCH_MIN_INTERVAL_MS) continue;
+    
+    for (int n = 0; n < activeSwitchNumNotes[i]; n++) {
+      if (!sendMidiPolyPressure(activeSwitchNotes[i][n], pressure)) {
+        // Budget erschöpft: beim nächsten Aufruf mit diesem Switch weitermachen
+        aftertouchNextSwitch = i;
+        return;
+      }
+    }
+    switchAftertouch[i] = pressure;
+    switchAftertouchTime[i] = now;
+  }
+  if (++aftertouchNextSwitch >= NUM_SWITCHES) aftertouchNextSwitch = 0;
 }
 
 #endif
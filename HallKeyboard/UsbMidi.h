@@ -0,0 +1,288 @@
+/**
+ * USB MIDI LAYER (native USB des ATmega32U4)
+ *
+ * MIDI-Ausgabe parallel zu DIN über die USB-MIDI Class (MIDIUSB Library):
+ * - Alle Channel Messages eines loop()-Durchlaufs werden als 4-Byte USB-MIDI
+ *   Pakete gesammelt und höchstens einmal pro USB-Frame (1 ms) geflusht
+ *   -> ein Akkord geht in einem einzigen USB-Transfer raus
+ * - MIDI Clock kommt aus dem Timer1 ISR als Zähler (USB darf nicht aus dem ISR
+ *   bedient werden) und wird beim nächsten Flush vor den übrigen Paketen gesendet
+ * - Blockiert nie: gesendet wird nur, was in die freie Endpoint-Bank passt
+ *   (USB_SendSpace), der Rest bleibt für den nächsten Frame im Batch. Liest der
+ *   Host den Endpoint nicht (z.B. DAW mit geschlossenem Port), würde USB_Send()
+ *   sonst bis zu 250 ms warten und loop() anhalten
+ * - Host-Stub (USB_MIDI_HOST_STUB): ohne Arduino-Core, Pakete landen in
+ *   usbMidiHostPackets[] statt auf dem USB-Endpoint, damit die Batching-Logik
+ *   auf dem PC geprüft werden kann (tests/usb_midi_test.cpp)
+ *
+ * INPUT:
+ *   - usbMidiQueueMessage() aus dem MIDI Output-Encoder (MidiGenerator.h)
+ *   - usbMidiClockTick() aus dem Clock ISR, usbMidiQueueRealtime() aus loop()
+ * OUTPUT:
+ *   - USB-MIDI Pakete (Cable 0) via MidiUSB bzw. Host-Stub
+ *   - usbMidiStats - verworfene Pakete/Clocks bei vollem Endpoint
+ */
+
+#ifndef USB_MIDI_H
+#define USB_MIDI_H
+
+#ifdef USB_MIDI_HOST_STUB
+#include <stdint.h>
+#else
+#include "arduino_stubs.h"
+#endif
+
+#ifndef USB_MIDI_ENABLED
+#if defined(USBCON) || defined(USB_MIDI_HOST_STUB)
+#define USB_MIDI_ENABLED 1
+#else
+#define USB_MIDI_ENABLED 0
+#endif
+#endif
+
+#if USB_MIDI_ENABLED && !defined(USB_MIDI_HOST_STUB)
+#include <MIDIUSB.h>
+#endif
+
+// ============================================
+// USB MIDI CONFIG & STATE
+// ============================================
+
+#define USB_MIDI_BATCH_SIZE   16    // Pakete pro Frame (64 Bytes = eine Endpoint-Bank)
+#define USB_MIDI_CABLE        0
+#define USB_MIDI_PACKET_SIZE  4
+#define USB_MIDI_MAX_PENDING_CLOCKS 24   // Liest der Host nicht: höchstens ein Beat Clocks aufheben
+
+struct UsbMidiPacket {
+  uint8_t header;   // Cable Number << 4 | Code Index Number
+  uint8_t byte1;
+  uint8_t byte2;
+  uint8_t byte3;
+};
+
+UsbMidiPacket usbMidiBatch[USB_MIDI_BATCH_SIZE];
+uint8_t usbMidiBatchCount = 0;
+volatile uint8_t usbMidiPendingClocks = 0;   // Vom Timer1 ISR gezählt
+uint8_t usbMidiLastFrame = 0;
+bool usbMidiRealtimeQueued = false;          // Start/Stop/Continue im Batch: neue Clocks dahinter
+
+struct UsbMidiStats {
+  uint16_t droppedPackets;    // Batch voll und Endpoint belegt
+  uint16_t droppedClocks;     // Mehr als USB_MIDI_MAX_PENDING_CLOCKS ausstehend
+};
+UsbMidiStats usbMidiStats;
+
+#ifdef USB_MIDI_HOST_STUB
+#define USB_MIDI_HOST_PACKETS 64
+UsbMidiPacket usbMidiHostPackets[USB_MIDI_HOST_PACKETS];
+uint8_t usbMidiHostPacketCount = 0;
+uint16_t usbMidiHostFlushCount = 0;
+uint8_t usbMidiHostFrame = 0;           // Vom Test weitergezählt
+uint8_t usbMidiHostSendSpace = 64;      // Freie Bytes im Endpoint, vom Test gesetzt
+#endif
+
+// ============================================
+// USB TRANSPORT (Gerät oder Host-Stub)
+// ============================================
+
+#ifdef USB_MIDI_HOST_STUB
+inline void usbMidiSendPacket(const UsbMidiPacket &p) {
+  if (usbMidiHostPacketCount < USB_MIDI_HOST_PACKETS) usbMidiHostPackets[usbMidiHostPacketCount++] = p;
+  usbMidiHostSendSpace = (usbMidiHostSendSpace >= USB_MIDI_PACKET_SIZE) ? usbMidiHostSendSpace - USB_MIDI_PACKET_SIZE : 0;
+}
+inline void usbMidiFlushTransport() { usbMidiHostFlushCount++; }
+inline uint8_t usbMidiFrameNumber() { return usbMidiHostFrame; }
+inline uint8_t usbMidiSendSpace() { return usbMidiHostSendSpace; }
+
+// Kein ISR auf dem Host
+inline uint8_t usbMidiTakePendingClocks() {
+  uint8_t clocks = usbMidiPendingClocks;
+  usbMidiPendingClocks = 0;
+  return clocks;
+}
+inline void usbMidiRestorePendingClocks(uint8_t clocks) { usbMidiPendingClocks += clocks; }
+#elif USB_MIDI_ENABLED
+/**
+ * Endpoint-Nummer des MIDI-IN Endpoints (MIDI_TX in MIDIUSB.h greift auf das
+ * geschützte pluggedEndpoint zu, daher der Umweg über einen Member-Pointer)
+ */
+struct UsbMidiEndpoint : MIDI_ {
+  static uint8_t tx() { return (MidiUSB.*(&UsbMidiEndpoint::pluggedEndpoint)) + 1; }
+};
+
+inline void usbMidiSendPacket(const UsbMidiPacket &p) {
+  midiEventPacket_t event = {p.header, p.byte1, p.byte2, p.byte3};
+  MidiUSB.sendMIDI(event);
+}
+inline void usbMidiFlushTransport() { MidiUSB.flush(); }
+inline uint8_t usbMidiFrameNumber() { return UDFNUML; }   // Start-of-Frame Zähler (1 kHz)
+inline uint8_t usbMidiSendSpace() { return USB_SendSpace(UsbMidiEndpoint::tx()); }   // 0 = Bank belegt/nicht konfiguriert
+
+inline uint8_t usbMidiTakePendingClocks() {
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t clocks = usbMidiPendingClocks;
+  usbMidiPendingClocks = 0;
+  SREG = sreg;
+  return clocks;
+}
+inline void usbMidiRestorePendingClocks(uint8_t clocks) {
+  uint8_t sreg = SREG;
+  cli();
+  usbMidiPendingClocks += clocks;
+  SREG = sreg;
+}
+#endif
+
+// ============================================
+// USB MIDI FUNCTIONS
+// ============================================
+
+#if USB_MIDI_ENABLED
+
+/**
+ * Ausstehende Clock-Pulse senden, soweit Platz im Endpoint ist.
+ * Rückgabe: true wenn mindestens ein Puls gesendet wurde
+ */
+bool sendUsbMidiClocks(uint8_t &clocks) {
+  bool sentClock = false;
+  UsbMidiPacket clock = {(USB_MIDI_CABLE << 4) | 0x0F, 0xF8, 0, 0};
+  while (clocks > 0 && usbMidiSendSpace() >= USB_MIDI_PACKET_SIZE) {
+    usbMidiSendPacket(clock);
+    sentClock = true;
+    clocks--;
+  }
+  return sentClock;
+}
+
+/**
+ * Gesammelte Pakete senden, aber nur so viele, wie in den Endpoint passen.
+ * Der Rest bleibt für den nächsten Frame stehen.
+ * Ausstehende Clock-Pulse gehen vor den übrigen Paketen raus, nach einem
+ * eingereihten Start/Stop/Continue aber dahinter (dort schon gezählte Pulse
+ * stehen bereits im Batch)
+ */
+void sendUsbMidiBatch() {
+  uint8_t clocks = usbMidiTakePendingClocks();
+  if (clocks == 0 && usbMidiBatchCount == 0) return;
+
+  uint8_t sent = 0;
+  bool sentClock = false;
+  if (!usbMidiRealtimeQueued) sentClock = sendUsbMidiClocks(clocks);
+  while (sent < usbMidiBatchCount && usbMidiSendSpace() >= USB_MIDI_PACKET_SIZE) {
+    usbMidiSendPacket(usbMidiBatch[sent++]);
+  }
+  if (sent == usbMidiBatchCount) {
+    if (usbMidiRealtimeQueued) sentClock = sendUsbMidiClocks(clocks);
+    usbMidiRealtimeQueued = false;
+  }
+
+  if (clocks > 0) {
+    // Nicht unbegrenzt sammeln, sonst kommt beim Öffnen des Ports ein Clock-Schwall
+    if (clocks > USB_MIDI_MAX_PENDING_CLOCKS) {
+      usbMidiStats.droppedClocks += clocks - USB_MIDI_MAX_PENDING_CLOCKS;
+      clocks = USB_MIDI_MAX_PENDING_CLOCKS;
+    }
+    usbMidiRestorePendingClocks(clocks);
+  }
+  if (sent > 0) {
+    for (uint8_t i = sent; i < usbMidiBatchCount; i++) usbMidiBatch[i - sent] = usbMidiBatch[i];
+    usbMidiBatchCount -= sent;
+  }
+  if (sent > 0 || sentClock) usbMidiFlushTransport();
+}
+
+inline void queueUsbMidiPacket(uint8_t cin, uint8_t b1, uint8_t b2, uint8_t b3) {
+  if (usbMidiBatchCount >= USB_MIDI_BATCH_SIZE) sendUsbMidiBatch(); // Voll: vorzeitig senden
+  if (usbMidiBatchCount >= USB_MIDI_BATCH_SIZE) {
+    usbMidiStats.droppedPackets++;   // Endpoint belegt (Host liest nicht): verwerfen statt warten
+    return;
+  }
+  UsbMidiPacket &p = usbMidiBatch[usbMidiBatchCount++];
+  p.header = (USB_MIDI_CABLE << 4) | cin;
+  p.byte1 = b1;
+  p.byte2 = b2;
+  p.byte3 = b3;
+}
+
+/**
+ * Channel Message (immer mit vollem Status, USB kennt keinen Running Status)
+ */
+void usbMidiQueueMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+  uint8_t type = status & 0xF0;
+  if (type == 0xC0 || type == 0xD0) data2 = 0;   // Nur ein Datenbyte
+  queueUsbMidiPacket(type >> 4, status, data1, data2);
+}
+
+/**
+ * System Common Message (1-3 Bytes, z.B. Song Position Pointer)
+ */
+void usbMidiQueueSystem(uint8_t status, uint8_t data1, uint8_t data2, uint8_t length) {
+  static const uint8_t cin[4] = {0x05, 0x05, 0x02, 0x03};   // Code Index nach Länge
+  if (length > 3) length = 3;
+  queueUsbMidiPacket(cin[length], status, length > 1 ? data1 : 0, length > 2 ? data2 : 0);
+}
+
+/**
+ * Teil einer SysEx Message in 3-Byte Paketen. Ohne 'end' muss length ein
+ * Vielfaches von 3 sein (Stream, MidiThru.h), mit 'end' endet der Teil mit 0xF7.
+ */
+void usbMidiQueueSysExChunk(const uint8_t *data, uint8_t length, bool end) {
+  while (length > 3 || (length == 3 && !end)) {
+    queueUsbMidiPacket(0x04, data[0], data[1], data[2]);   // SysEx Start/Fortsetzung
+    data += 3;
+    length -= 3;
+  }
+  if (length == 0) return;
+  queueUsbMidiPacket(0x04 + length, data[0], length > 1 ? data[1] : 0, length > 2 ? data[2] : 0);   // Ende mit 1-3 Bytes
+}
+
+/**
+ * Komplette SysEx Message (0xF0 ... 0xF7)
+ */
+inline void usbMidiQueueSysEx(const uint8_t *data, uint8_t length) {
+  usbMidiQueueSysExChunk(data, length, true);
+}
+
+/**
+ * Clock-Puls aus dem Timer1 ISR: nur zählen, gesendet wird in loop()
+ */
+inline void usbMidiClockTick() {
+  if (usbMidiPendingClocks < 0xFF) usbMidiPendingClocks++;
+}
+
+/**
+ * Realtime-Byte aus loop() (Start/Stop/Continue). Bereits gezählte Clock-Pulse
+ * werden vorher eingereiht, damit die Reihenfolge wie auf DIN bleibt.
+ */
+void usbMidiQueueRealtime(uint8_t b) {
+  uint8_t clocks = usbMidiTakePendingClocks();
+  while (clocks--) queueUsbMidiPacket(0x0F, 0xF8, 0, 0);
+  queueUsbMidiPacket(0x0F, b, 0, 0);
+  usbMidiRealtimeQueued = true;
+}
+
+/**
+ * Einmal pro loop() am Ende aufrufen: sendet den Batch, sobald ein neuer
+ * USB-Frame begonnen hat (mehrere kurze loop()-Durchläufe landen im selben Transfer)
+ */
+void flushUsbMidi() {
+  uint8_t frame = usbMidiFrameNumber();
+  if (frame == usbMidiLastFrame) return;
+  usbMidiLastFrame = frame;
+  sendUsbMidiBatch();
+}
+
+#else
+
+inline void usbMidiQueueMessage(uint8_t, uint8_t, uint8_t) {}
+inline void usbMidiQueueSystem(uint8_t, uint8_t, uint8_t, uint8_t) {}
+inline void usbMidiQueueSysExChunk(const uint8_t *, uint8_t, bool) {}
+inline void usbMidiQueueSysEx(const uint8_t *, uint8_t) {}
+inline void usbMidiClockTick() {}
+inline void usbMidiQueueRealtime(uint8_t) {}
+inline void flushUsbMidi() {}
+
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * HOST TEST: Clock-PLL (MidiClockReceiver.h)
+ *
+ * Speist Pulsfolgen über den RX-ISR ein und prüft, dass die Takt-Position
+ * (Anzahl gezählter Pulse) trotz Ausreißern und ausgefallener Pulse stimmt.
+ */
+
+#include <stdio.h>
+#include "MidiClockReceiver.h"
+
+// ============================================
+// STUBS FÜR DIE ÜBRIGEN LAYER
+// ============================================
+ArduinoTapTempo tapTempo;
+unsigned long clockIntervalMicros = 20833;
+
+uint32_t countedPulses = 0;   // Summe aus handleExternalClockPulse()
+
+void setMidiClockPosition(uint32_t pulses) { countedPulses = pulses; }
+void handleExternalClockPulse(unsigned long pulseMicros, uint8_t pulses) { countedPulses += pulses; }
+void resetArpeggiatorPhase() {}
+void syncArpeggiatorToSongPosition(uint32_t pulses) {}
+void stopArpeggiatorNote() {}
+
+// ============================================
+// TEST HELPERS
+// ============================================
+#define PERIOD 20833UL   // 120 BPM
+
+int failures = 0;
+
+void expect(const char *name, uint32_t got, uint32_t expected) {
+  printf("%-40s %s (got %lu, expected %lu)\n", name, got == expected ? "ok  " : "FAIL",
+         (unsigned long)got, (unsigned long)expected);
+  if (got != expected) failures++;
+}
+
+void receive(uint8_t b, unsigned long at) {
+  hostMicros = at;
+  UDR1 = b;
+  USART1_RX_vect();
+  updateMidiClockReceiver();
+}
+
+/**
+ * Neuer Lauf: Start, dann 'lockPulses' Pulse im Raster (PLL rastet ein)
+ */
+unsigned long startRun(unsigned long t, uint8_t lockPulses) {
+  initMidiClockReceiver();
+  midiClockPllStats.outliers = 0;
+  midiClockPllStats.missedPulses = 0;
+  midiClockPllStats.relocks = 0;
+  receive(0xFA, t);
+  for (uint8_t i = 0; i < lockPulses; i++) {
+    t += PERIOD;
+    receive(0xF8, t);
+  }
+  return t;
+}
+
+// ============================================
+// TESTS
+// ============================================
+
+void testCleanTrain() {
+  unsigned long t = startRun(1000, 48);
+  expect("clean train", countedPulses, 48);
+  expect("clean train: no outliers", midiClockPllStats.outliers, 0);
+}
+
+void testLateOutlier() {
+  // Ein echter Puls kommt 7 ms zu spät (> P/4): zählt genau einmal
+  unsigned long t = startRun(1000, 48);
+  receive(0xF8, t + PERIOD + 7000);
+  t += PERIOD;
+  for (uint8_t i = 0; i < 24; i++) {
+    t += PERIOD;
+    receive(0xF8, t);
+  }
+  expect("late outlier", countedPulses, 48 + 1 + 24);
+  expect("late outlier: rejected", midiClockPllStats.outliers, 1);
+  expect("late outlier: no bridged pulse", midiClockPllStats.missedPulses, 0);
+}
+
+void testDuplicate() {
+  // Doppelter Puls 300 µs nach einem echten: zählt gar nicht
+  unsigned long t = startRun(1000, 48);
+  receive(0xF8, t + 300);
+  for (uint8_t i = 0; i < 24; i++) {
+    t += PERIOD;
+    receive(0xF8, t);
+  }
+  expect("duplicate", countedPulses, 48 + 24);
+  expect("duplicate: rejected", midiClockPllStats.outliers, 1);
+}
+
+void testEarlyOutlier() {
+  // Ein Puls 7 ms zu früh, der echte Puls fehlt nicht: Ausreißer zählt nicht
+  unsigned long t = startRun(1000, 48);
+  receive(0xF8, t + PERIOD - 7000);
+  for (uint8_t i = 0; i < 24; i++) {
+    t += PERIOD;
+    receive(0xF8, t);
+  }
+  expect("early outlier", countedPulses, 48 + 24);
+}
+
+void testDroppedPulse() {
+  // Ein Puls fehlt (z.B. RX-Überlauf): wird überbrückt und mitgezählt
+  unsigned long t = startRun(1000, 48);
+  t += PERIOD;   // Fehlt
+  for (uint8_t i = 0; i < 24; i++) {
+    t += PERIOD;
+    receive(0xF8, t);
+  }
+  expect("dropped pulse", countedPulses, 48 + 1 + 24);
+  expect("dropped pulse: bridged", midiClockPllStats.missedPulses, 1);
+}
+
+void testStopThenTimeout() {
+  // DAW sendet nach Stop keine Clock mehr: Timeout gibt den Arp für die interne Clock frei
+  unsigned long t = startRun(1000, 48);
+  receive(0xFC, t + 1000);
+  expect("stop: stopped", midiClockStopped, 1);
+  hostMicros = t + MIDI_CLOCK_TIMEOUT_MICROS + 1000;
+  updateMidiClockReceiver();
+  expect("stop + timeout: clock inactive", midiClockActive, 0);
+  expect("stop + timeout: no longer stopped", midiClockStopped, 0);
+}
+
+int main() {
+  initMidiUart();
+  testCleanTrain();
+  testLateOutlier();
+  testDuplicate();
+  testEarlyOutlier();
+  testDroppedPulse();
+  testStopThenTimeout();
+  if (failures) {
+    printf("%d FAILED\n", failures);
+    return 1;
+  }
+  printf("all passed\n");
+  return 0;
+}
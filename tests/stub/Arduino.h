@@ -0,0 +1,152 @@
+/**
+ * HOST STUB: Arduino.h
+ *
+ * Minimaler Ersatz für den AVR-Core, damit einzelne Layer mit g++ auf dem
+ * Host übersetzt und getestet werden können:
+ * - Register als einfache Variablen (stub.cpp), cli()/sei() ohne Wirkung
+ * - micros()/millis() aus hostMicros, vom Test gesteuert
+ * - ISR(v) wird zu einer normalen Funktion, die der Test direkt aufruft
+ */
+
+#ifndef HOST_STUB_ARDUINO_H
+#define HOST_STUB_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+#define A4 22
+#define A5 23
+
+#define PROGMEM
+#define F(x) x
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+
+#define ISR(v) extern "C" void v(void)
+#define _BV(b) (1 << (b))
+#define bit(b) (1UL << (b))
+#define bitRead(v, b) (((v) >> (b)) & 1)
+#define F_CPU 16000000UL
+#define USBCON
+
+inline void cli() {}
+inline void sei() {}
+
+// ============================================
+// REGISTER (Definitionen in stub.cpp)
+// ============================================
+#define HOST_REG(n) extern volatile uint8_t n;
+#define HOST_REG16(n) extern volatile uint16_t n;
+HOST_REG(SREG)
+HOST_REG(PINB) HOST_REG(PINC) HOST_REG(PIND) HOST_REG(PINE) HOST_REG(PINF)
+HOST_REG(PORTB) HOST_REG(PORTC) HOST_REG(PORTD) HOST_REG(PORTE) HOST_REG(PORTF)
+HOST_REG(DDRB) HOST_REG(DDRC) HOST_REG(DDRD) HOST_REG(DDRE) HOST_REG(DDRF)
+HOST_REG(UDFNUML)
+HOST_REG(TCCR1A) HOST_REG(TCCR1B) HOST_REG(TIMSK1) HOST_REG16(TCNT1) HOST_REG16(OCR1A)
+HOST_REG(TCCR3A) HOST_REG(TCCR3B) HOST_REG(TIMSK3) HOST_REG(TIFR3) HOST_REG16(TCNT3) HOST_REG16(OCR3A)
+HOST_REG(ADMUX) HOST_REG(ADCSRA) HOST_REG(ADCSRB) HOST_REG(DIDR0) HOST_REG(DIDR2)
+HOST_REG(ADCL) HOST_REG(ADCH) HOST_REG16(ADC)
+HOST_REG(UCSR1A) HOST_REG(UCSR1B) HOST_REG(UCSR1C) HOST_REG(UDR1) HOST_REG16(UBRR1)
+#undef HOST_REG
+#undef HOST_REG16
+
+#define WGM12 3
+#define WGM32 3
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define OCIE1A 1
+#define OCIE3A 1
+#define OCF3A 1
+#define TOV3 0
+#define REFS0 6
+#define ADLAR 5
+#define MUX5 5
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define RXEN1 4
+#define TXEN1 3
+#define RXCIE1 7
+#define UDRIE1 5
+#define TXCIE1 6
+#define UDRE1 5
+#define RXC1 7
+#define TXC1 6
+#define U2X1 1
+#define UCSZ11 2
+#define UCSZ10 1
+#define FE1 4
+#define DOR1 3
+
+// ============================================
+// ZEIT UND PINS
+// ============================================
+extern unsigned long hostMicros;   // Vom Test gesetzt
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+
+template<class T> T constrain(T x, T a, T b) { return x < a ? a : (x > b ? b : x); }
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+class Print {
+public:
+  size_t write(uint8_t b) { return 1; }
+  size_t print(const char* s) { return 0; }
+  size_t print(long v, int base = 10) { return 0; }
+  size_t print(unsigned long v, int base = 10) { return 0; }
+  size_t print(int v, int base = 10) { return 0; }
+  size_t print(unsigned int v, int base = 10) { return 0; }
+  size_t println(const char* s) { return 0; }
+  size_t println(long v, int base = 10) { return 0; }
+  size_t println(unsigned long v, int base = 10) { return 0; }
+  size_t println(int v, int base = 10) { return 0; }
+  size_t println(unsigned int v, int base = 10) { return 0; }
+  size_t println() { return 0; }
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  void flush() {}
+  operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * HOST STUB: Register, Zeit und Pins für die Host-Tests
+ */
+
+#include "Arduino.h"
+
+#define HOST_REG(n) volatile uint8_t n;
+#define HOST_REG16(n) volatile uint16_t n;
+HOST_REG(SREG)
+HOST_REG(PINB) HOST_REG(PINC) HOST_REG(PIND) HOST_REG(PINE) HOST_REG(PINF)
+HOST_REG(PORTB) HOST_REG(PORTC) HOST_REG(PORTD) HOST_REG(PORTE) HOST_REG(PORTF)
+HOST_REG(DDRB) HOST_REG(DDRC) HOST_REG(DDRD) HOST_REG(DDRE) HOST_REG(DDRF)
+HOST_REG(UDFNUML)
+HOST_REG(TCCR1A) HOST_REG(TCCR1B) HOST_REG(TIMSK1) HOST_REG16(TCNT1) HOST_REG16(OCR1A)
+HOST_REG(TCCR3A) HOST_REG(TCCR3B) HOST_REG(TIMSK3) HOST_REG(TIFR3) HOST_REG16(TCNT3) HOST_REG16(OCR3A)
+HOST_REG(ADMUX) HOST_REG(ADCSRA) HOST_REG(ADCSRB) HOST_REG(DIDR0) HOST_REG(DIDR2)
+HOST_REG(ADCL) HOST_REG(ADCH) HOST_REG16(ADC)
+HOST_REG(UCSR1A) HOST_REG(UCSR1B) HOST_REG(UCSR1C) HOST_REG(UDR1) HOST_REG16(UBRR1)
+
+unsigned long hostMicros = 0;
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+unsigned long millis() { return hostMicros / 1000; }
+unsigned long micros() { return hostMicros; }
+void delay(unsigned long ms) { hostMicros += ms * 1000; }
+void delayMicroseconds(unsigned int us) { hostMicros += us; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int analogRead(uint8_t pin) { return 0; }
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
@@ -0,0 +1,168 @@
+/**
+ * HOST TEST: USB-MIDI Batching (UsbMidi.h mit USB_MIDI_HOST_STUB)
+ *
+ * Ohne Arduino-Core übersetzt: prüft die Paketierung, höchstens einen Flush
+ * pro USB-Frame, die Clock-Pakete aus dem ISR-Pfad und dass bei belegtem
+ * Endpoint nichts blockiert.
+ */
+
+#include <stdio.h>
+#include "UsbMidi.h"
+
+// ============================================
+// TEST HELPERS
+// ============================================
+int failures = 0;
+
+void expect(const char *name, uint32_t got, uint32_t expected) {
+  printf("%-44s %s (got %lu, expected %lu)\n", name, got == expected ? "ok  " : "FAIL",
+         (unsigned long)got, (unsigned long)expected);
+  if (got != expected) failures++;
+}
+
+void expectPacket(const char *name, uint8_t index, uint8_t header, uint8_t b1, uint8_t b2, uint8_t b3) {
+  const UsbMidiPacket &p = usbMidiHostPackets[index];
+  uint32_t got = ((uint32_t)p.header << 24) | ((uint32_t)p.byte1 << 16) | ((uint32_t)p.byte2 << 8) | p.byte3;
+  uint32_t expected = ((uint32_t)header << 24) | ((uint32_t)b1 << 16) | ((uint32_t)b2 << 8) | b3;
+  expect(name, got, expected);
+}
+
+void reset() {
+  usbMidiBatchCount = 0;
+  usbMidiPendingClocks = 0;
+  usbMidiLastFrame = 0;
+  usbMidiRealtimeQueued = false;
+  usbMidiStats.droppedPackets = 0;
+  usbMidiStats.droppedClocks = 0;
+  usbMidiHostPacketCount = 0;
+  usbMidiHostFlushCount = 0;
+  usbMidiHostFrame = 0;
+  usbMidiHostSendSpace = 64;
+}
+
+/**
+ * Nächster USB-Frame: Host hat die Bank abgeholt, loop() flusht
+ */
+void nextFrame() {
+  usbMidiHostFrame++;
+  usbMidiHostSendSpace = 64;
+  flushUsbMidi();
+}
+
+// ============================================
+// TESTS
+// ============================================
+
+void testPacking() {
+  reset();
+  usbMidiQueueMessage(0x91, 60, 100);                 // Note On ch2
+  usbMidiQueueMessage(0xC0, 5, 77);                   // Program Change: ein Datenbyte
+  usbMidiQueueSystem(0xF2, 0x10, 0x02, 3);            // Song Position Pointer
+  const uint8_t sysex[5] = {0xF0, 0x7D, 0x01, 0x02, 0xF7};
+  usbMidiQueueSysEx(sysex, 5);
+  nextFrame();
+  expect("packing: packet count", usbMidiHostPacketCount, 5);
+  expectPacket("packing: note on", 0, 0x09, 0x91, 60, 100);
+  expectPacket("packing: program change", 1, 0x0C, 0xC0, 5, 0);
+  expectPacket("packing: song position", 2, 0x03, 0xF2, 0x10, 0x02);
+  expectPacket("packing: sysex start", 3, 0x04, 0xF0, 0x7D, 0x01);
+  expectPacket("packing: sysex end (2 bytes)", 4, 0x06, 0x02, 0xF7, 0);
+}
+
+void testOneFlushPerFrame() {
+  reset();
+  nextFrame();
+  usbMidiQueueMessage(0x90, 60, 100);
+  flushUsbMidi();                                     // Gleicher Frame: noch nichts
+  usbMidiQueueMessage(0x90, 64, 100);
+  usbMidiQueueMessage(0x90, 67, 100);
+  flushUsbMidi();
+  expect("frame: nothing sent within frame", usbMidiHostPacketCount, 0);
+  nextFrame();
+  flushUsbMidi();
+  flushUsbMidi();
+  expect("frame: chord in one transfer", usbMidiHostPacketCount, 3);
+  expect("frame: one flush", usbMidiHostFlushCount, 1);
+  nextFrame();
+  expect("frame: empty frame not flushed", usbMidiHostFlushCount, 1);
+}
+
+void testClockTicks() {
+  reset();
+  usbMidiQueueMessage(0x90, 60, 100);
+  usbMidiClockTick();                                 // Aus dem Timer1 ISR
+  usbMidiClockTick();
+  nextFrame();
+  expect("clock: packet count", usbMidiHostPacketCount, 3);
+  expectPacket("clock: first clock before notes", 0, 0x0F, 0xF8, 0, 0);
+  expectPacket("clock: second clock", 1, 0x0F, 0xF8, 0, 0);
+  expectPacket("clock: then note", 2, 0x09, 0x90, 60, 100);
+
+  // Start nach bereits gezählten Clocks: Reihenfolge wie auf DIN
+  reset();
+  usbMidiClockTick();
+  usbMidiQueueRealtime(0xFA);
+  usbMidiClockTick();
+  nextFrame();
+  expect("clock: realtime packet count", usbMidiHostPacketCount, 3);
+  expectPacket("clock: tick before start", 0, 0x0F, 0xF8, 0, 0);
+  expectPacket("clock: start", 1, 0x0F, 0xFA, 0, 0);
+  expectPacket("clock: tick after start", 2, 0x0F, 0xF8, 0, 0);
+}
+
+void testEndpointBusy() {
+  // Host liest den Endpoint nicht: nichts senden, nichts verlieren, nicht warten
+  reset();
+  usbMidiQueueMessage(0x90, 60, 100);
+  usbMidiClockTick();
+  usbMidiHostFrame++;
+  usbMidiHostSendSpace = 0;
+  flushUsbMidi();
+  expect("busy: nothing sent", usbMidiHostPacketCount, 0);
+  expect("busy: no flush", usbMidiHostFlushCount, 0);
+  expect("busy: note kept", usbMidiBatchCount, 1);
+  expect("busy: clock kept", usbMidiPendingClocks, 1);
+  nextFrame();
+  expect("busy: sent when space returns", usbMidiHostPacketCount, 2);
+
+  // Nur Platz für zwei Pakete: Rest im nächsten Frame, Reihenfolge bleibt
+  reset();
+  for (uint8_t i = 0; i < 4; i++) usbMidiQueueMessage(0x90, 60 + i, 100);
+  usbMidiHostFrame++;
+  usbMidiHostSendSpace = 8;
+  flushUsbMidi();
+  expect("partial: first two sent", usbMidiHostPacketCount, 2);
+  expect("partial: two kept", usbMidiBatchCount, 2);
+  nextFrame();
+  expect("partial: all sent", usbMidiHostPacketCount, 4);
+  expectPacket("partial: order kept", 2, 0x09, 0x90, 62, 100);
+
+  // Batch voll bei belegtem Endpoint: neue Pakete verwerfen und zählen
+  reset();
+  usbMidiHostSendSpace = 0;
+  for (uint8_t i = 0; i < USB_MIDI_BATCH_SIZE + 3; i++) usbMidiQueueMessage(0x90, 60, 100);
+  expect("full: batch kept", usbMidiBatchCount, USB_MIDI_BATCH_SIZE);
+  expect("full: drops counted", usbMidiStats.droppedPackets, 3);
+
+  // Clocks sammeln sich nicht unbegrenzt
+  reset();
+  for (uint8_t i = 0; i < 100; i++) usbMidiClockTick();
+  usbMidiHostFrame++;
+  usbMidiHostSendSpace = 0;
+  flushUsbMidi();
+  expect("clocks: capped", usbMidiPendingClocks, USB_MIDI_MAX_PENDING_CLOCKS);
+  expect("clocks: drops counted", usbMidiStats.droppedClocks, 100 - USB_MIDI_MAX_PENDING_CLOCKS);
+}
+
+int main() {
+  testPacking();
+  testOneFlushPerFrame();
+  testClockTicks();
+  testEndpointBusy();
+  if (failures) {
+    printf("%d FAILED\n", failures);
+    return 1;
+  }
+  printf("all passed\n");
+  return 0;
+}